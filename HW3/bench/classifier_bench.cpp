@@ -0,0 +1,87 @@
+#include "block_classifier.hpp"
+#include "block_size.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+using u8 = std::uint8_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+// All-zero blocks are the worst case: every byte has to be looked at
+constexpr u64 image_bytes{ 64UL << 20 };
+constexpr int rounds{ 8 };
+
+template<typename Classify>
+double measure(const std::vector<u8>& image,
+               u64 block_size,
+               std::span<const u8> identifier,
+               Classify classify)
+{
+    u64 empty{ 0 };
+    auto const start{ std::chrono::steady_clock::now() };
+    for (int r{ 0 }; r < rounds; ++r)
+    {
+        for (u64 off{ 0 }; off < image.size(); off += block_size)
+        {
+            std::span<const u8> block{ image.data() + off, block_size };
+            empty += classify(block, identifier) == block_class::empty;
+        }
+    }
+    std::chrono::duration<double> const elapsed{
+        std::chrono::steady_clock::now() - start
+    };
+    if (empty != rounds * image.size() / block_size)
+    {
+        std::fprintf(stderr, "unexpected classification\n");
+    }
+    return static_cast<double>(rounds * image.size()) / elapsed.count() / 1e9;
+}
+} // namespace
+
+int main()
+{
+    std::vector<u8> const image(image_bytes, 0);
+    std::vector<u8> identifier(32, 0);
+    identifier[0] = 1;
+
+    std::printf("kernel: %s\n", block_classifier_isa());
+    std::printf("%-10s %12s %12s %12s %8s\n",
+                "block",
+                "scalar GB/s",
+                "simd GB/s",
+                "fixed GB/s",
+                "speedup");
+    for (u64 block_size : { 1024UL, 2048UL, 4096UL })
+    {
+        double const scalar{ measure(
+          image, block_size, identifier, classify_block_scalar) };
+        double const simd{ measure(
+          image,
+          block_size,
+          identifier,
+          [](auto block, auto wanted)
+          { return classify_block(block, wanted); }) };
+        // the kernel recext2fs picks for this block size
+        double const fixed{ dispatch_block_size(
+          block_size,
+          [&](auto size)
+          {
+              return measure(image,
+                             block_size,
+                             identifier,
+                             classify_block<decltype(size)::value>);
+          }) };
+        std::printf("%-10lu %12.2f %12.2f %12.2f %7.1fx\n",
+                    block_size,
+                    scalar,
+                    simd,
+                    fixed,
+                    fixed / scalar);
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "options.hpp"
+#include "worker_pool.hpp"
+
+// Recovers every image listed in the manifest opts.batch_path with the other
+// flags of opts. Each manifest line holds an image followed by its
+// identifier bytes; blank lines and lines starting with '#' are skipped.
+// Several images are recovered at once and their block groups share pool,
+// so small images fill the gaps left by large ones. Returns false when the
+// manifest is unusable or any image failed.
+bool recover_batch(const options& opts, worker_pool& pool) noexcept;
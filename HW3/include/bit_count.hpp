@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// Number of set bits among the first bit_count bits of a bitmap, bit i being
+// bit i % 8 of byte i / 8 as ext2 lays them out. Bits past bit_count, such
+// as the padding at the end of a bitmap block, are ignored. The kernel is
+// picked once at startup (AVX2 nibble lookup, POPCNT, then portable).
+std::uint64_t count_set_bits(std::span<const std::uint8_t> bitmap,
+                             std::uint64_t bit_count) noexcept;
+
+// Name of the kernel count_set_bits dispatches to
+const char* bit_count_isa() noexcept;
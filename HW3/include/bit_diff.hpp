@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Half-open run of bit positions [first, end)
+struct bit_range
+{
+    std::uint64_t first;
+    std::uint64_t end;
+};
+
+// Runs of differing bits among the first bit_count bits of two bitmaps,
+// compared a 64 bit word at a time with XOR. Adjacent differences merge into
+// one range, so a wiped bitmap comes back as a handful of ranges rather than
+// one entry per bit.
+std::vector<bit_range> differing_bits(std::span<const std::uint8_t> lhs,
+                                      std::span<const std::uint8_t> rhs,
+                                      std::uint64_t bit_count) noexcept;
+
+// Offset of the first byte at or after from where the two spans differ, or
+// the shorter size when they agree. Identical stretches are skipped with a
+// vector XOR (AVX-512, AVX2 or SSE2, picked once at startup).
+std::uint64_t first_difference(std::span<const std::uint8_t> lhs,
+                               std::span<const std::uint8_t> rhs,
+                               std::uint64_t from = 0) noexcept;
+
+// Eight bitmap bytes starting at from_byte as one word. On little endian
+// hosts bit i of the word is bit i % 8 of byte i / 8, as ext2 numbers them.
+// Bytes past the end of the bitmap read as zero.
+std::uint64_t load_word(std::span<const std::uint8_t> bitmap,
+                        std::uint64_t from_byte) noexcept;
+
+// Appends [first, end) to ranges, merging it into the last range when the
+// two touch
+void append_range(std::vector<bit_range>& ranges,
+                  std::uint64_t first,
+                  std::uint64_t end);
+
+// Appends the runs of set bits of word, bit i standing for position base + i
+void append_bits(std::vector<bit_range>& ranges,
+                 std::uint64_t word,
+                 std::uint64_t base);
+
+// Name of the kernel first_difference dispatches to
+const char* bit_diff_isa() noexcept;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+enum class block_class : std::uint8_t
+{
+    empty,      /* every byte is zero */
+    identifier, /* starts with the data identifier */
+    nonzero,    /* anything else */
+};
+
+// Classifies a whole block. The kernel is picked once at startup from the
+// best instruction set the CPU supports (AVX-512, AVX2, then SSE2).
+block_class classify_block(std::span<const std::uint8_t> block,
+                           std::span<const std::uint8_t> identifier) noexcept;
+
+// Byte at a time reference implementation, kept for benchmarks
+block_class classify_block_scalar(
+  std::span<const std::uint8_t> block,
+  std::span<const std::uint8_t> identifier) noexcept;
+
+// Bit i of the result is set when block i of the chunk starts with the first
+// eight bytes of the identifier. A hit still needs a full comparison, the
+// prefilter only rules blocks out. count is at most 64.
+std::uint64_t identifier_prefilter(
+  const std::uint8_t* chunk,
+  std::uint64_t block_size,
+  std::uint32_t count,
+  std::span<const std::uint8_t> identifier) noexcept;
+
+// Full comparison of the block's head against the identifier
+bool has_identifier(std::span<const std::uint8_t> block,
+                    std::span<const std::uint8_t> identifier) noexcept;
+
+// classify_block and identifier_prefilter for a block size fixed at compile
+// time, so the zero check and the prefilter stride are constants. Only
+// 0, 1024, 2048, 4096 and 8192 are instantiated, 0 reads the size at
+// runtime.
+template<std::uint64_t BlockSize>
+block_class classify_block(std::span<const std::uint8_t> block,
+                           std::span<const std::uint8_t> identifier) noexcept;
+template<std::uint64_t BlockSize>
+std::uint64_t identifier_prefilter(
+  const std::uint8_t* chunk,
+  std::uint64_t block_size,
+  std::uint32_t count,
+  std::span<const std::uint8_t> identifier) noexcept;
+
+// Name of the kernel classify_block dispatches to
+const char* block_classifier_isa() noexcept;
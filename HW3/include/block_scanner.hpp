@@ -0,0 +1,140 @@
+#pragma once
+
+#include "recovery_stats.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Streams a run of consecutive blocks from an image descriptor in large
+// chunks and hands each block to a visitor. Callers that pass a hole visitor
+// get runs of blocks the file system reports as holes (SEEK_DATA/SEEK_HOLE,
+// else FIEMAP) without them being read. One scanner owns one buffer, so
+// concurrent scans need one scanner each.
+class block_scanner
+{
+   public:
+    using u8 = std::uint8_t;
+    using u64 = std::uint64_t;
+
+    static constexpr u64 default_chunk_size{ 4UL << 20 };
+
+    block_scanner(int fd,
+                  u64 block_size,
+                  u64 chunk_size = default_chunk_size,
+                  io_counters* counters = nullptr) noexcept;
+
+    // visit(index, block) is called for every block in order, index being
+    // relative to the first scanned block. Returns false on a read error.
+    template<typename Visitor>
+    bool scan(u64 offset, u64 block_count, Visitor&& visit) noexcept
+    {
+        return scan_chunks(offset, block_count, blocks_of(visit));
+    }
+
+    // Same, but runs of blocks lying in a hole of the image file go to
+    // skip(first, count) instead and are never read
+    template<typename Visitor, typename HoleVisitor>
+    bool scan(u64 offset,
+              u64 block_count,
+              Visitor&& visit,
+              HoleVisitor&& skip) noexcept
+    {
+        return scan_chunks(offset, block_count, blocks_of(visit), skip);
+    }
+
+    // visit(first, data, count) sees whole chunks of count blocks at a time
+    template<typename Visitor>
+    bool scan_chunks(u64 offset, u64 block_count, Visitor&& visit) noexcept
+    {
+        return read_blocks(offset, 0, block_count, visit);
+    }
+
+    template<typename Visitor, typename HoleVisitor>
+    bool scan_chunks(u64 offset,
+                     u64 block_count,
+                     Visitor&& visit,
+                     HoleVisitor&& skip) noexcept
+    {
+        for (u64 first{ 0 }; first < block_count;)
+        {
+            block_range const data{ next_data(offset, first, block_count) };
+            if (data.first > first)
+            {
+                if (counters != nullptr)
+                {
+                    counters->bytes_skipped.fetch_add(
+                      (data.first - first) * block_size,
+                      std::memory_order_relaxed);
+                }
+                skip(first, data.first - first);
+            }
+            if (!read_blocks(offset, data.first, data.end, visit))
+            {
+                return false;
+            }
+            first = data.end;
+        }
+        return true;
+    }
+
+   private:
+    enum class extent_query
+    {
+        seek,   /* lseek with SEEK_DATA and SEEK_HOLE */
+        fiemap, /* FS_IOC_FIEMAP, for file systems without SEEK_DATA */
+        none,   /* neither works, everything counts as data */
+    };
+
+    // blocks [first, end) relative to the scan start
+    struct block_range
+    {
+        u64 first;
+        u64 end;
+    };
+
+    int fd;
+    u64 block_size;
+    std::vector<u8> buffer;
+    extent_query query{ extent_query::seek };
+    io_counters* counters;
+
+    template<typename Visitor>
+    auto blocks_of(Visitor& visit) const noexcept
+    {
+        return [&visit, this](u64 first, const u8* data, u64 count)
+        {
+            for (u64 i{ 0 }; i < count; ++i)
+            {
+                visit(first + i,
+                      std::span<const u8>{ data + i * block_size,
+                                           block_size });
+            }
+        };
+    }
+
+    template<typename Visitor>
+    bool read_blocks(u64 offset, u64 first, u64 end, Visitor& visit) noexcept
+    {
+        u64 const blocks_per_chunk{ buffer.size() / block_size };
+        for (; first < end; first += blocks_per_chunk)
+        {
+            u64 const count{ std::min(blocks_per_chunk, end - first) };
+            if (!read_chunk(offset + first * block_size, count * block_size))
+            {
+                return false;
+            }
+            visit(first, static_cast<const u8*>(buffer.data()), count);
+        }
+        return true;
+    }
+
+    bool read_chunk(u64 offset, u64 length) noexcept;
+    // Next run of blocks holding data at or after first. Blocks only partly
+    // in a hole count as data. first == end when the rest is a hole.
+    block_range next_data(u64 offset, u64 first, u64 block_count) noexcept;
+    // Byte range of the next data extent at or after from, false if none
+    bool seek_data(u64 from, u64& start, u64& end) noexcept;
+    bool fiemap_data(u64 from, u64& start, u64& end) noexcept;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Flat bitset over absolute block numbers
+class block_set
+{
+   public:
+    using u64 = std::uint64_t;
+
+    explicit block_set(u64 bits) noexcept
+      : bit_count{ bits }
+      , words((bits + 63) / 64, 0)
+    {
+    }
+    block_set(u64 bits, std::vector<u64> words) noexcept
+      : bit_count{ bits }
+      , words{ std::move(words) }
+    {
+    }
+
+    void set(u64 i) noexcept { words[i / 64] |= u64{ 1 } << (i % 64); }
+    void reset(u64 i) noexcept { words[i / 64] &= ~(u64{ 1 } << (i % 64)); }
+    bool test(u64 i) const noexcept
+    {
+        return (words[i / 64] >> (i % 64)) & 1U;
+    }
+    u64 size() const noexcept { return bit_count; }
+
+   private:
+    u64 bit_count;
+    std::vector<u64> words;
+};
+
+// block_set that many threads can set bits in at once
+class atomic_block_set
+{
+   public:
+    using u64 = std::uint64_t;
+
+    explicit atomic_block_set(u64 bits) noexcept
+      : bit_count{ bits }
+      , words((bits + 63) / 64)
+    {
+    }
+
+    // Returns whether the bit was already set, so exactly one of several
+    // threads setting the same bit sees false
+    bool set(u64 i) noexcept
+    {
+        u64 const mask{ u64{ 1 } << (i % 64) };
+        return (words[i / 64].fetch_or(mask, std::memory_order_relaxed) &
+                mask) != 0;
+    }
+    bool test(u64 i) const noexcept
+    {
+        return (words[i / 64].load(std::memory_order_relaxed) >> (i % 64)) &
+               1U;
+    }
+    u64 size() const noexcept { return bit_count; }
+
+    // Plain copy, once every thread is done setting bits
+    block_set snapshot() const noexcept
+    {
+        std::vector<u64> plain(words.size());
+        for (u64 i{ 0 }; i < words.size(); ++i)
+        {
+            plain[i] = words[i].load(std::memory_order_relaxed);
+        }
+        return { bit_count, std::move(plain) };
+    }
+
+   private:
+    u64 bit_count;
+    std::vector<std::atomic<u64>> words;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// Recovery kernels are instantiated for the common block sizes so loops over
+// a block have a constant trip count. BlockSize 0 is the generic fallback
+// that reads the size at runtime.
+template<std::uint64_t BlockSize>
+constexpr std::uint64_t fixed_block_size(std::uint64_t runtime) noexcept
+{
+    if constexpr (BlockSize != 0)
+    {
+        return BlockSize;
+    }
+    else
+    {
+        return runtime;
+    }
+}
+
+// Calls visit with std::integral_constant<std::uint64_t, N> for the
+// specialised sizes and with N = 0 for everything else
+template<typename Visitor>
+decltype(auto) dispatch_block_size(std::uint64_t block_size, Visitor&& visit)
+{
+    using u64 = std::uint64_t;
+    switch (block_size)
+    {
+        case 1024:
+            return visit(std::integral_constant<u64, 1024>{});
+        case 2048:
+            return visit(std::integral_constant<u64, 2048>{});
+        case 4096:
+            return visit(std::integral_constant<u64, 4096>{});
+        case 8192:
+            return visit(std::integral_constant<u64, 8192>{});
+        default:
+            return visit(std::integral_constant<u64, 0>{});
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "block_set.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Sidecar file recording which block groups have been rebuilt and flushed
+// to the image. save() writes a temporary file, syncs it and renames it over
+// the old one, so the file on disk is always either the previous or the new
+// state, never a mix.
+class checkpoint
+{
+   public:
+    using u8 = std::uint8_t;
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    // identity ties the file to one image, a mismatch means start over
+    struct identity
+    {
+        u64 image_size;
+        u32 block_count;
+        u32 inode_count;
+        u32 blocks_per_group;
+        u32 group_count;
+    };
+
+    checkpoint(std::string path, identity image) noexcept;
+
+    // Picks up the groups recorded by an earlier run. Returns false when
+    // there is no usable file, in which case nothing is marked done.
+    bool load() noexcept;
+    bool save() const noexcept;
+    void remove() const noexcept;
+
+    bool done(u32 bg_num) const noexcept { return finished.test(bg_num); }
+    void mark(u32 bg_num) noexcept { finished.set(bg_num); }
+    u32 done_count() const noexcept;
+
+   private:
+    std::string path;
+    identity image;
+    block_set finished;
+};
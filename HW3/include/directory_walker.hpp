@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+#include "worker_pool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// What a walk of the directory tree found
+struct link_census
+{
+    // entries of reachable directories naming each inode, "." and ".."
+    // included. For a consistent file system references[ino] equals its
+    // link_count, and 0 means the inode cannot be reached from the root.
+    std::vector<std::uint32_t> references;
+    std::uint64_t directories{ 0 };
+    std::uint64_t entries{ 0 };
+};
+
+// Breadth-first walk of the directory tree from the root inode. Every
+// thread of the pool owns a queue of directories to read, takes work from
+// the front of its own and, once that runs dry, steals from the back of
+// the others. A directory is entered once even when damage links it twice.
+class directory_walker
+{
+   public:
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    directory_walker(const mapped_image& image, const geometry& geo) noexcept;
+
+    link_census walk(worker_pool& pool) const noexcept;
+
+    u32 inode_count() const noexcept { return inodes; }
+    const ext2_inode& inode(u32 ino) const noexcept;
+
+   private:
+    const mapped_image& image;
+    const geometry& geo;
+    u32 inodes;
+};
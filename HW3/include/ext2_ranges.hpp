@@ -0,0 +1,239 @@
+#pragma once
+
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string_view>
+
+// Zero-copy traversal of an ext2 image. Every view points into the mapping,
+// nothing is copied, and the ranges are cheap to make and to copy. They only
+// read the image, and block numbers outside the file system are skipped
+// rather than followed, so damaged images are safe to walk.
+//
+//     for (inode_view const& node : inode_range{ image, geo, bg_num })
+//         for (block_view const& b : inode_block_range{ image, geo, node })
+//             ...
+
+// Layouts of all groups in order
+inline std::span<const group_layout> group_range(const geometry& geo) noexcept
+{
+    return geo.groups();
+}
+
+struct inode_view
+{
+    std::uint32_t number;          /* 1-based inode number */
+    std::span<const std::uint8_t> record; /* the whole on-disk record */
+
+    const ext2_inode& inode() const noexcept
+    {
+        return *reinterpret_cast<const ext2_inode*>(record.data());
+    }
+    // Has a mode and has not been deleted
+    bool live() const noexcept
+    {
+        return inode().mode != 0 && inode().deletion_time == 0;
+    }
+};
+
+// Every inode record of one group, live or not
+class inode_range
+{
+   public:
+    using u32 = std::uint32_t;
+
+    inode_range(const mapped_image& image,
+                const geometry& geo,
+                u32 bg_num) noexcept;
+
+    class iterator
+    {
+       public:
+        using value_type = inode_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() noexcept = default;
+        iterator(const inode_range* range, u32 index) noexcept;
+
+        inode_view operator*() const noexcept;
+        iterator& operator++() noexcept
+        {
+            ++index;
+            return *this;
+        }
+        iterator operator++(int) noexcept
+        {
+            iterator old{ *this };
+            ++index;
+            return old;
+        }
+        bool operator==(const iterator& other) const noexcept
+        {
+            return index == other.index;
+        }
+
+       private:
+        const inode_range* range{ nullptr };
+        u32 index{ 0 };
+    };
+
+    iterator begin() const noexcept { return { this, 0 }; }
+    iterator end() const noexcept { return { this, count }; }
+    u32 size() const noexcept { return count; }
+
+   private:
+    std::span<const std::uint8_t> table;
+    u32 record_size;
+    u32 first_number;
+    u32 count;
+};
+
+struct block_view
+{
+    std::uint64_t logical; /* first file block the block holds or maps */
+    std::uint32_t number;  /* absolute block number */
+    std::uint32_t depth;   /* 0 for data, 1 to 3 for indirect blocks */
+    std::span<const std::uint8_t> data;
+};
+
+// Blocks an inode points at, direct ones first, then the single, double and
+// triple indirect trees in depth-first order. Holes are skipped. Indirect
+// blocks are only visited when asked for; fast symlinks have no blocks.
+class inode_block_range
+{
+   public:
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    inode_block_range(const mapped_image& image,
+                      const geometry& geo,
+                      const ext2_inode& inode,
+                      bool with_indirect = false) noexcept;
+
+    class iterator
+    {
+       public:
+        using value_type = block_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() noexcept = default;
+        explicit iterator(const inode_block_range* range) noexcept;
+
+        const block_view& operator*() const noexcept { return current; }
+        const block_view* operator->() const noexcept { return &current; }
+        iterator& operator++() noexcept
+        {
+            advance();
+            return *this;
+        }
+        iterator operator++(int) noexcept
+        {
+            iterator old{ *this };
+            advance();
+            return old;
+        }
+        bool operator==(std::default_sentinel_t) const noexcept
+        {
+            return done;
+        }
+
+       private:
+        // one indirect block being walked
+        struct frame
+        {
+            const u32* entries;
+            u32 index;
+            u32 child_depth;
+            u64 base;   /* logical block of entry 0 */
+            u64 stride; /* logical blocks covered by one entry */
+        };
+
+        const inode_block_range* range{ nullptr };
+        std::array<frame, 3> stack{};
+        u32 levels{ 0 };
+        u32 slot{ 0 };
+        bool done{ true };
+        block_view current{};
+
+        void advance() noexcept;
+    };
+
+    iterator begin() const noexcept { return iterator{ this }; }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+   private:
+    const mapped_image* image;
+    u32 block_count;
+    u64 per_block;
+    bool with_indirect;
+    // direct pointers followed by the three indirect roots
+    std::array<u32, EXT2_NUM_DIRECT_BLOCKS + 3> roots{};
+};
+
+struct dir_entry_view
+{
+    std::uint32_t offset; /* byte offset of the record in its block */
+    const ext2_dir_entry* entry;
+    std::string_view name;
+};
+
+// Records of one directory block that name an inode. Walking stops at the
+// first record whose length does not fit the block.
+class dir_entry_range
+{
+   public:
+    using u32 = std::uint32_t;
+
+    explicit dir_entry_range(std::span<const std::uint8_t> block) noexcept
+      : block{ block }
+    {
+    }
+
+    class iterator
+    {
+       public:
+        using value_type = dir_entry_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() noexcept = default;
+        explicit iterator(std::span<const std::uint8_t> block) noexcept;
+
+        const dir_entry_view& operator*() const noexcept { return current; }
+        const dir_entry_view* operator->() const noexcept { return &current; }
+        iterator& operator++() noexcept
+        {
+            advance();
+            return *this;
+        }
+        iterator operator++(int) noexcept
+        {
+            iterator old{ *this };
+            advance();
+            return old;
+        }
+        bool operator==(std::default_sentinel_t) const noexcept
+        {
+            return done;
+        }
+
+       private:
+        std::span<const std::uint8_t> block;
+        u32 next{ 0 };
+        bool done{ true };
+        dir_entry_view current{};
+
+        void advance() noexcept;
+    };
+
+    iterator begin() const noexcept { return iterator{ block }; }
+    std::default_sentinel_t end() const noexcept { return {}; }
+
+   private:
+    std::span<const std::uint8_t> block;
+};
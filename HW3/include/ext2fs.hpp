@@ -6,6 +6,7 @@
 #define EXT2_SUPER_BLOCK_SIZE 1024
 #define EXT2_SUPER_BLOCK_POSITION EXT2_BOOT_BLOCK_SIZE
 #define EXT2_ROOT_INODE 2
+#define EXT2_RESIZE_INODE 7
 #ifndef EXT2_INODE_SIZE
 #define EXT2_INODE_SIZE 256
 #endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "block_classifier.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+// One fixed-width record per block of the file system
+struct block_fingerprint
+{
+    block_class kind;
+};
+static_assert(sizeof(block_fingerprint) == 1);
+
+// Sidecar file holding the classification of every block of an image,
+// mapped into memory. It is an exact-match cache: a sidecar whose identity
+// matches the image answers classification without reading the image, any
+// other one is ignored and a new one is recorded during the scan and
+// replaces the old file by rename on commit.
+class fingerprint_index
+{
+   public:
+    using u8 = std::uint8_t;
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    // An image is taken as unchanged while its size and modification time
+    // are, so any write to it, recovery's own included, means a full scan.
+    // The identifier is part of it because classes depend on it.
+    struct identity
+    {
+        u64 image_size;
+        u64 modified_ns;
+        u64 identifier_hash;
+        u32 block_size;
+        u32 block_count;
+    };
+
+    fingerprint_index(std::string path, identity image) noexcept;
+    ~fingerprint_index() noexcept;
+
+    fingerprint_index(const fingerprint_index&) = delete;
+    fingerprint_index(fingerprint_index&&) = delete;
+
+    fingerprint_index& operator=(const fingerprint_index&) = delete;
+    fingerprint_index& operator=(fingerprint_index&&) = delete;
+
+    static identity describe(int image_fd,
+                             u64 block_size,
+                             u32 block_count,
+                             std::span<const u8> identifier) noexcept;
+
+    // Maps an existing sidecar. Returns false when there is none or it
+    // belongs to another image or identifier.
+    bool load() noexcept;
+    // Starts recording a new sidecar next to the old one
+    bool create() noexcept;
+    // Publishes a recorded sidecar; only call once every block is recorded
+    bool commit() noexcept;
+    // Drops a recording that could not be completed
+    void discard() noexcept;
+
+    // The sidecar matched the image, lookups are valid
+    bool current() const noexcept { return loaded; }
+    // A new sidecar is being recorded
+    bool recording() const noexcept { return records != nullptr && !loaded; }
+
+    const block_fingerprint& at(u32 b_num) const noexcept
+    {
+        return records[b_num];
+    }
+    // Blocks are independent, workers may record different blocks at once
+    void record(u32 b_num, block_class kind) noexcept
+    {
+        records[b_num] = { kind };
+    }
+
+   private:
+    std::string path;
+    identity image;
+    void* mapping{ nullptr };
+    u64 mapping_size{ 0 };
+    block_fingerprint* records{ nullptr };
+    bool loaded{ false };
+
+    std::string temporary() const { return path + ".tmp"; }
+    void unmap() noexcept;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ext2fs.hpp"
+#include "mapped_image.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_FEATURE_INCOMPAT_META_BG 0x0010
+
+// Where everything of one block group lives, in absolute block numbers
+struct group_layout
+{
+    std::uint32_t first_block;      /* First block of the group */
+    std::uint32_t block_count;      /* Blocks in the group, last can be short */
+    bool has_super_block;           /* Group keeps a super block copy */
+    std::uint64_t super_block;      /* Byte offset of that copy */
+    std::uint32_t descriptor_table; /* First block of the descriptor copy */
+    std::uint32_t block_bitmap;
+    std::uint32_t inode_bitmap;
+    std::uint32_t inode_table;
+    std::uint32_t metadata_end; /* First block past the inode table */
+};
+
+// Layout of the file system computed once at open time. Every address
+// calculation on the hot paths is a lookup into the group table or a shift.
+class geometry
+{
+   public:
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    // throws std::runtime_error when the super block or a descriptor does
+    // not describe a file system that fits the image
+    explicit geometry(const mapped_image& image);
+
+    const group_layout& group(u32 bg_num) const noexcept
+    {
+        return layouts[bg_num];
+    }
+    u32 group_count() const noexcept { return layouts.size(); }
+    std::span<const group_layout> groups() const noexcept { return layouts; }
+
+    u64 block_size() const noexcept { return u64{ 1 } << block_shift; }
+    u64 block_offset(u32 b_num) const noexcept
+    {
+        return static_cast<u64>(b_num) << block_shift;
+    }
+    // Entry of bg_num in the primary descriptor table
+    u64 descriptor_offset(u32 bg_num) const noexcept
+    {
+        return descriptor_table + bg_num * sizeof(ext2_block_group_descriptor);
+    }
+    u64 inode_offset(u32 bg_num, u32 index) const noexcept
+    {
+        return block_offset(layouts[bg_num].inode_table) +
+               static_cast<u64>(index) * inode_bytes;
+    }
+
+    u32 block_count() const noexcept { return blocks; }
+    u32 first_data_block() const noexcept { return first_data; }
+    u32 blocks_per_group() const noexcept { return group_blocks; }
+    u32 inodes_per_group() const noexcept { return group_inodes; }
+    u32 inode_size() const noexcept { return inode_bytes; }
+    u32 inode_table_blocks() const noexcept { return table_blocks; }
+    u32 first_inode() const noexcept { return first_ino; }
+
+    // Super block copies, descriptors, bitmaps and inode tables
+    bool is_metadata(u32 b_num) const noexcept;
+
+    static bool has_super_block(u32 bg_num, bool sparse) noexcept;
+
+   private:
+    u32 block_shift;
+    u32 blocks;
+    u32 first_data;
+    u32 group_blocks;
+    u32 group_inodes;
+    u32 inode_bytes;
+    u32 table_blocks;
+    u32 first_ino;
+    u64 descriptor_table;
+    std::vector<group_layout> layouts;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mapped_image.hpp"
+#include "recovery_stats.hpp"
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Bounded LRU cache of decoded indirect blocks. A decoded block is the list
+// of its non-zero pointers that fall inside the file system, in on-disk
+// order, so walks skip the empty tail without touching it again. Entries
+// are spread over shards with a lock each; lookups from parallel walks only
+// contend when they hash to the same shard. Blocks are decoded from the
+// image itself and never dropped on a write, so the cache only describes
+// the image as it was before recovery staged or wrote any change.
+class indirect_cache
+{
+   public:
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+    using pointer_list = std::vector<u32>;
+
+    indirect_cache(const mapped_image& image,
+                   u64 block_size,
+                   u32 block_count,
+                   u64 budget,
+                   cache_counters* counters = nullptr) noexcept;
+
+    // Decoded contents of block b_num. The list stays valid after the entry
+    // is evicted.
+    std::shared_ptr<const pointer_list> pointers(u32 b_num) const noexcept;
+
+   private:
+    static constexpr u32 shard_bits{ 4 };
+    static constexpr u32 shard_count{ 1U << shard_bits };
+
+    struct entry
+    {
+        u32 b_num;
+        std::shared_ptr<const pointer_list> pointers;
+        u64 bytes;
+    };
+    struct shard
+    {
+        std::mutex lock;
+        std::list<entry> recent; /* most recently used first */
+        std::unordered_map<u32, std::list<entry>::iterator> index;
+        u64 bytes{ 0 };
+    };
+
+    const mapped_image& image;
+    u64 block_size;
+    u32 block_count;
+    u64 shard_budget;
+    cache_counters* counters;
+    mutable std::array<shard, shard_count> shards;
+
+    shard& shard_of(u32 b_num) const noexcept;
+    pointer_list decode(u32 b_num) const noexcept;
+};
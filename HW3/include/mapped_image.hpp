@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ext2fs.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+enum class image_access
+{
+    read_write,
+    read_only, /* opened and mapped without write permission */
+};
+
+// Maps the whole image into memory and hands out typed views into it. Every
+// view aliases the mapping, so writes through a view land in the image and
+// are flushed by sync() or at destruction. Writing to a read-only image
+// faults.
+class mapped_image
+{
+   public:
+    using u8 = std::uint8_t;
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    explicit mapped_image(const std::string& location,
+                          image_access access = image_access::read_write);
+    ~mapped_image() noexcept;
+
+    mapped_image(const mapped_image&) = delete;
+    mapped_image(mapped_image&&) = delete;
+
+    mapped_image& operator=(const mapped_image&) = delete;
+    mapped_image& operator=(mapped_image&&) = delete;
+
+    template<typename T>
+    T& view(u64 offset) const noexcept
+    {
+        return *reinterpret_cast<T*>(base + offset);
+    }
+
+    ext2_super_block& super_block() const noexcept
+    {
+        return view<ext2_super_block>(EXT2_SUPER_BLOCK_POSITION);
+    }
+    ext2_block_group_descriptor& group_desc(u64 offset) const noexcept
+    {
+        return view<ext2_block_group_descriptor>(offset);
+    }
+    ext2_inode& inode(u64 offset) const noexcept
+    {
+        return view<ext2_inode>(offset);
+    }
+
+    std::span<u8> bytes(u64 offset, u64 length) const noexcept
+    {
+        return { base + offset, static_cast<std::size_t>(length) };
+    }
+    // b_num is an absolute block number
+    std::span<u8> block(u32 b_num) const noexcept
+    {
+        return bytes(static_cast<u64>(b_num) * block_size, block_size);
+    }
+
+    u64 size() const noexcept { return length; }
+    int descriptor() const noexcept { return fd; }
+    bool writable() const noexcept
+    {
+        return access == image_access::read_write;
+    }
+
+    void sync() const noexcept;
+
+   private:
+    int fd{ -1 };
+    u8* base{ nullptr };
+    u64 length{};
+    u64 block_size{};
+    image_access access;
+};
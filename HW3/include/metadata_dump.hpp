@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ext2_ranges.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+#include "worker_pool.hpp"
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+enum class dump_format
+{
+    jsonl, /* one JSON object per line, "record" names the kind */
+    csv,   /* one row per record, kind first; "#kind,..." rows name columns */
+};
+
+// Formats metadata records into a growing text buffer with std::to_chars.
+// One writer per thread; clear() keeps the allocation for the next batch.
+class record_writer
+{
+   public:
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    explicit record_writer(dump_format format) noexcept;
+
+    // Column names of every record kind, CSV only
+    void header();
+    void super_block(const ext2_super_block& sb);
+    void group(u32 bg_num, const ext2_block_group_descriptor& bg);
+    void inode(u32 number, const ext2_inode& inode);
+    void dir_entry(u32 directory, u32 block, const dir_entry_view& entry);
+
+    std::string_view text() const noexcept
+    {
+        return { buffer.data(), buffer.size() };
+    }
+    void clear() noexcept { buffer.clear(); }
+
+   private:
+    dump_format format;
+    std::vector<char> buffer;
+
+    void begin(std::string_view kind);
+    void end();
+    void field(std::string_view name, u64 value);
+    void field(std::string_view name, std::string_view value);
+    void append(std::string_view text);
+};
+
+// Writes every super block field, group descriptor, inode and directory
+// entry of the image to out. Groups are formatted in parallel and written in
+// group order, so the output does not depend on the thread count.
+void dump_metadata(const mapped_image& image,
+                   const geometry& geo,
+                   worker_pool& pool,
+                   dump_format format,
+                   std::ostream& out);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class rebuild_mode
+{
+    content,  /* classify every block by its contents */
+    pointers, /* follow the block pointers of every live inode */
+};
+
+enum class link_check
+{
+    none,
+    report, /* walk the directory tree and list wrong link counts */
+    fix,    /* ... and write the counted links back */
+};
+
+enum class dump_format;
+
+// Command line of recext2fs. Arguments starting with "--" are flags and may
+// appear anywhere, the rest are the image followed by the identifier bytes.
+struct options
+{
+    std::string image_location;
+    std::vector<std::uint8_t> data_identifier;
+    unsigned threads{ default_threads() };
+    rebuild_mode mode{ rebuild_mode::content };
+    bool list_orphans{ false };
+    bool repair_pointers{ false };
+    // recover in memory only and leave the image untouched
+    bool dry_run{ false };
+    // skip block groups a previous run recorded in the checkpoint file
+    bool resume{ false };
+    // open the image read-only and report how its bitmaps differ instead
+    bool verify{ false };
+    // memory for decoded indirect blocks when the walk is followed by
+    // pointer repair, in MiB; 0 reads every indirect block from the image
+    unsigned indirect_cache_mib{ 64 };
+    // where --stats writes its JSON document, "-" for stdout, empty for off
+    std::string stats_path;
+    // write all metadata to stdout in this format instead of recovering
+    std::optional<dump_format> dump;
+    // block class sidecar, an empty path means <image>.fingerprints
+    std::optional<std::string> fingerprints;
+    link_check links{ link_check::none };
+    // extract deleted files into this directory instead of recovering
+    std::string undelete_dir;
+    // recover every image listed in this file instead of a single one
+    std::string batch_path;
+    // print the super block and group descriptors, off in batch mode where
+    // the dumps of several images would interleave
+    bool print_metadata{ true };
+
+    static options parse(int argc, char* argv[]);
+    // Identifier bytes written as hexadecimal numbers
+    static std::vector<std::uint8_t> parse_identifier(
+      std::span<const std::string_view> bytes);
+    static unsigned default_threads() noexcept;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "block_set.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Blocks that no live inode points at. Kept sorted for a deterministic walk
+// and as a bitset for O(1) membership tests. Repair passes claim blocks as
+// they hand them out, after which they no longer count as members.
+class orphan_index
+{
+   public:
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    orphan_index(u64 block_count, std::vector<u32> blocks) noexcept
+      : members{ block_count }
+      , sorted{ std::move(blocks) }
+    {
+        std::sort(sorted.begin(), sorted.end());
+        for (u32 b : sorted)
+        {
+            members.set(b);
+        }
+        remaining = sorted.size();
+    }
+
+    bool contains(u32 b_num) const noexcept
+    {
+        return b_num < members.size() && members.test(b_num);
+    }
+    void claim(u32 b_num) noexcept
+    {
+        if (contains(b_num))
+        {
+            members.reset(b_num);
+            --remaining;
+        }
+    }
+    // Lowest unclaimed member that is not below from, 0 when there is none
+    u32 next(u32 from = 0) const noexcept
+    {
+        auto it{ std::lower_bound(sorted.begin(), sorted.end(), from) };
+        while (it != sorted.end() && !members.test(*it))
+        {
+            ++it;
+        }
+        return it == sorted.end() ? 0 : *it;
+    }
+
+    const std::vector<u32>& blocks() const noexcept { return sorted; }
+    u64 size() const noexcept { return sorted.size(); }
+    u64 unclaimed() const noexcept { return remaining; }
+
+   private:
+    block_set members;
+    std::vector<u32> sorted;
+    u64 remaining{};
+};
+
+// Orphans split by content: data blocks carry the identifier, untagged ones
+// are the lost indirect and directory blocks
+struct orphan_blocks
+{
+    orphan_index data;
+    orphan_index untagged;
+};
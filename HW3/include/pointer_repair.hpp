@@ -0,0 +1,88 @@
+#pragma once
+
+#include "block_set.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "orphan_index.hpp"
+#include "write_back.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+// An inode the pointer walk reached fewer blocks of than its
+// block_count_512 accounts for, data and indirect blocks together
+struct damaged_inode
+{
+    std::uint32_t number;
+    std::uint64_t missing;
+};
+
+// Fills holes in inode pointer arrays with orphaned blocks. Lost indirect
+// blocks are recognised by their contents and handed out whole, data holes
+// get the nearest orphan after the previous block of the file. Blocks are
+// assigned in ascending order, so the result only depends on the image.
+// Holes are filled front to back only until the missing count is met, the
+// remaining ones belong to sparse files. An indirect pointer past the end
+// of the file system or into group metadata counts as a hole.
+class pointer_repair
+{
+   public:
+    using u8 = std::uint8_t;
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    pointer_repair(write_back& staged,
+                   const geometry& geo,
+                   orphan_blocks& orphans,
+                   block_set& used) noexcept;
+
+    // Stages up to damaged.missing pointers of the inode, whose record
+    // starts at inode_offset in the image, and returns how many were
+    // restored, adopted indirect blocks included. Reserved inodes other
+    // than the root are left alone.
+    u32 repair(const damaged_inode& damaged, u64 inode_offset) noexcept;
+
+   private:
+    // Progress on one inode: blocks reached against the missing count,
+    // pointers staged and the block the previous pointer went to
+    struct fill
+    {
+        u64 missing;
+        u64 reached;
+        u32 restored;
+        u32 near;
+    };
+
+    write_back& staged;
+    const geometry& geo;
+    u32 block_count;
+    u64 block_size;
+    u64 per_block;
+    orphan_blocks& orphans;
+    block_set& used;
+
+    // depth of every orphan that looks like an indirect block
+    std::unordered_map<u32, u32> pointer_depth;
+    // orphans not nested in another orphan indirect block, by depth - 1
+    std::array<std::optional<orphan_index>, 3> top_level;
+    // first directory block of each directory inode, found by its "." entry
+    std::unordered_map<u32, u32> dot_blocks;
+    block_set is_dot_block;
+
+    const u32* pointers(u32 b_num) const noexcept;
+    bool looks_like_pointers(u32 b_num) const noexcept;
+    u32 depth_of(u32 b_num) const noexcept;
+    void reserve_children(u32 b_num) noexcept;
+    void adopt(u32 b_num, fill& state) noexcept;
+    bool followable(u32 b_num) const noexcept;
+
+    // Byte offset of the pointer to logical block, 0 if it cannot be reached
+    u64 locate_slot(u64 inode_offset, u64 logical, fill& state) noexcept;
+    u32 claim_pointer_block(u32 depth, fill& state) noexcept;
+    u32 claim_data_block(u32 ino,
+                         bool directory,
+                         u64 logical,
+                         u32 near) noexcept;
+};
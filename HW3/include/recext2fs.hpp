@@ -1,35 +1,177 @@
 #pragma once
 
+#include "block_set.hpp"
 #include "ext2fs.hpp"
+#include "fingerprint_index.hpp"
+#include "geometry.hpp"
+#include "indirect_cache.hpp"
+#include "mapped_image.hpp"
+#include "options.hpp"
+#include "orphan_index.hpp"
+#include "pointer_repair.hpp"
+#include "recovery_stats.hpp"
+#include "worker_pool.hpp"
+#include "write_back.hpp"
 
+#include <atomic>
 #include <cstdint>
-#include <fstream>
-#include <string>
+#include <iostream>
+#include <optional>
+#include <ostream>
 #include <vector>
 
+// A block that more than one owner claims
+struct cross_link
+{
+    std::uint32_t block;
+    std::vector<std::uint32_t> owners; /* inode numbers, 0 for group metadata */
+};
+
 class recext2fs
 {
    public:
     using u8 = std::uint8_t;
     using u32 = std::uint32_t;
     using u64 = std::uint64_t;
-    using i64 = std::int64_t;
-    using pos = std::ifstream::pos_type;
 
-    explicit recext2fs(int argc, char* argv[]);
-    void recover_bitmap() noexcept;
+    // Group work runs on pool, which may be shared with other recoveries.
+    // Reports go to out, apart from the --print-metadata tables.
+    recext2fs(options settings,
+              worker_pool& pool,
+              std::ostream& out = std::cout);
+    // Returns false when writing back failed or, with --verify, when the
+    // on-disk bitmaps differ from the rebuilt ones
+    bool recover_bitmap() noexcept;
+
+    const recovery_stats& statistics() const noexcept { return stats; }
 
    private:
-    std::string image_location;
-    std::fstream image;
-    std::vector<u8> data_identifier;
+    recovery_stats stats;
+    options opts;
+    worker_pool& pool;
+    std::ostream& out;
+    mapped_image image;
+    phase_lap opened{ stats, recovery_phase::open };
 
-    ext2_super_block super_block{};
+    ext2_super_block& super_block;
+    geometry geo;
     u64 block_size{};
 
-    std::vector<u8> static parse_identifier(int argc, char* argv[]) noexcept;
+    struct block_claims;
+    // Kernels specialised for the image's block size, picked once in the
+    // constructor
+    struct kernel_table
+    {
+        std::vector<u8> (recext2fs::*scan_block_bitmap)(u32) noexcept;
+        std::vector<u8> (recext2fs::*scan_inode_bitmap)(u32,
+                                                        u32&) const noexcept;
+        std::vector<u8> (recext2fs::*block_bitmap_from_set)(
+          u32,
+          const block_set&) const noexcept;
+        void (recext2fs::*locate_orphan_blocks)(u32,
+                                                const block_set&,
+                                                std::vector<u32>&,
+                                                std::vector<u32>&) noexcept;
+        u64 (recext2fs::*mark_indirect_blocks)(u32,
+                                               u32,
+                                               block_claims&) const noexcept;
+
+        template<u64 BlockSize>
+        static kernel_table make() noexcept;
+    };
+    kernel_table kernels;
+    // Claims of one walk task. The bitset is shared by every task, blocks
+    // this task found already claimed are kept for the cross-link report.
+    struct block_claims
+    {
+        atomic_block_set& used;
+        std::vector<u32> repeated;
+
+        void claim(u32 b_num) noexcept
+        {
+            if (used.set(b_num))
+            {
+                repeated.emplace_back(b_num);
+            }
+        }
+    };
+
+    // everything recovery changes goes through here before reaching the image
+    write_back staged;
+    // decoded indirect blocks shared by the pointer walk of a repair, the
+    // walk reads the image directly otherwise. Walks all run before
+    // repair_pointers stages its changes; nothing may walk after it.
+    std::optional<indirect_cache> indirect;
+    // classes from an earlier run, or the sidecar this run is recording
+    std::optional<fingerprint_index> prints;
+    std::atomic<u32> recorded_groups{ 0 };
+
+    bool recover() noexcept;
+    void report_stats() const noexcept;
+    void open_fingerprints() noexcept;
+    void save_fingerprints() noexcept;
     void read_super_block() noexcept;
-    ext2_block_group_descriptor read_block_group_desc(u32 bg_num) noexcept;
-    i64 constexpr get_block_group_position(u32 bg_num) const noexcept;
-    i64 constexpr get_block_position(u32 bg_num, u32 b_num) const noexcept;
+    ext2_block_group_descriptor& read_block_group_desc(u32 bg_num) noexcept;
+    bool verify_bitmaps(worker_pool& pool, const block_set* used) noexcept;
+    void rebuild_group(u32 bg_num,
+                       const block_set* used,
+                       u64& free_blocks,
+                       u64& free_inodes) noexcept;
+    void store_bitmap(u32 b_num, const std::vector<u8>& bitmap) noexcept;
+    void store_group_counts(u32 bg_num,
+                            u64 free_blocks,
+                            u64 free_inodes,
+                            u32 directories) noexcept;
+    void store_free_counts(u64 free_blocks, u64 free_inodes) noexcept;
+    std::vector<u8> scan_inode_bitmap(u32 bg_num,
+                                      u32& directories) const noexcept;
+    std::vector<u8> scan_block_bitmap(u32 bg_num) noexcept;
+    std::vector<u8> block_bitmap_from_set(u32 bg_num,
+                                          const block_set& used) const noexcept;
+    block_set collect_used_blocks(
+      std::vector<damaged_inode>* damaged = nullptr,
+      std::vector<cross_link>* cross_links = nullptr) noexcept;
+    std::vector<cross_link> find_owners(
+      const std::vector<u32>& repeated) noexcept;
+    void print_cross_links(
+      const std::vector<cross_link>& cross_links) const noexcept;
+    orphan_blocks locate_orphans(worker_pool& pool,
+                                 const block_set& referenced) noexcept;
+    void print_orphans(const orphan_blocks& orphans) const noexcept;
+    bool undelete_inodes(const block_set& used) noexcept;
+    bool check_links() noexcept;
+    void repair_pointers(orphan_blocks& orphans,
+                         const std::vector<damaged_inode>& damaged,
+                         block_set& used) noexcept;
+    void locate_orphan_blocks(u32 bg_num,
+                              const block_set& referenced,
+                              std::vector<u32>& data,
+                              std::vector<u32>& untagged) noexcept;
+    void mark_metadata_blocks(u32 bg_num,
+                              block_claims& claims) const noexcept;
+    u64 mark_inode_blocks(const ext2_inode& inode,
+                          block_claims& claims) const noexcept;
+    u64 mark_indirect_blocks(u32 b_num,
+                             u32 depth,
+                             block_claims& claims) const noexcept;
+
+    template<u64 BlockSize>
+    std::vector<u8> scan_block_bitmap_kernel(u32 bg_num) noexcept;
+    template<u64 BlockSize>
+    std::vector<u8> scan_inode_bitmap_kernel(u32 bg_num,
+                                             u32& directories) const noexcept;
+    template<u64 BlockSize>
+    std::vector<u8> block_bitmap_from_set_kernel(
+      u32 bg_num,
+      const block_set& used) const noexcept;
+    template<u64 BlockSize>
+    void locate_orphan_blocks_kernel(u32 bg_num,
+                                     const block_set& referenced,
+                                     std::vector<u32>& data,
+                                     std::vector<u32>& untagged) noexcept;
+    template<u64 BlockSize>
+    u64 mark_indirect_blocks_kernel(u32 b_num,
+                                    u32 depth,
+                                    block_claims& claims) const noexcept;
+    u64 expected_blocks(const ext2_inode& inode) const noexcept;
 };
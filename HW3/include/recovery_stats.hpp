@@ -0,0 +1,119 @@
+#pragma once
+
+#include "block_classifier.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// I/O done through system calls. Workers bump these concurrently, so they
+// are relaxed atomics; reads of the mapping are not counted.
+struct io_counters
+{
+    std::atomic<std::uint64_t> bytes_read{ 0 };
+    std::atomic<std::uint64_t> bytes_written{ 0 };
+    std::atomic<std::uint64_t> bytes_skipped{ 0 }; /* holes never read */
+    std::atomic<std::uint64_t> read_calls{ 0 };    /* pread, extent queries */
+    std::atomic<std::uint64_t> write_calls{ 0 };   /* pwritev, fdatasync, copies */
+
+    void add_read(std::uint64_t bytes) noexcept
+    {
+        bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+        read_calls.fetch_add(1, std::memory_order_relaxed);
+    }
+    void add_write(std::uint64_t bytes) noexcept
+    {
+        bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+        write_calls.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Lookups in the indirect block cache. Misses are the blocks actually
+// decoded, evictions the entries pushed out by the memory budget.
+struct cache_counters
+{
+    std::atomic<std::uint64_t> hits{ 0 };
+    std::atomic<std::uint64_t> misses{ 0 };
+    std::atomic<std::uint64_t> evictions{ 0 };
+
+    void add_hit() noexcept { hits.fetch_add(1, std::memory_order_relaxed); }
+    void add_miss() noexcept
+    {
+        misses.fetch_add(1, std::memory_order_relaxed);
+    }
+    void add_eviction() noexcept
+    {
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+enum class recovery_phase : std::uint8_t
+{
+    open,     /* parsing options, opening and mapping the image */
+    geometry, /* group layout and the super block and descriptor dumps */
+    scan,     /* pointer walk, orphan search and pointer repair */
+    rebuild,  /* bitmaps and counts of every group */
+    flush,    /* write back and fdatasync */
+};
+
+// Counters and phase times of one recovery. Phases are timed as laps: each
+// lap(p) charges the time since the previous lap to p. CPU time is that of
+// the whole process, so recoveries running side by side overlap in it.
+class recovery_stats
+{
+   public:
+    using u64 = std::uint64_t;
+
+    static constexpr std::size_t phase_count{ 5 };
+
+    recovery_stats() noexcept;
+
+    io_counters io;
+    cache_counters indirect;
+
+    // Blocks classified by content, a block looked at by two scans counts
+    // twice. Holes are blocks skipped without being read.
+    void add_classified(block_class outcome, u64 blocks) noexcept
+    {
+        classified[static_cast<std::size_t>(outcome)].fetch_add(
+          blocks, std::memory_order_relaxed);
+    }
+    void add_holes(u64 blocks) noexcept
+    {
+        hole_blocks.fetch_add(blocks, std::memory_order_relaxed);
+    }
+
+    void lap(recovery_phase phase) noexcept;
+    // Adds the counters and phase times of other, for batch totals
+    void add(const recovery_stats& other) noexcept;
+
+    // One JSON object, keys in a fixed order, without a trailing newline
+    void write_json(std::ostream& out,
+                    const std::string& image,
+                    unsigned threads) const;
+
+   private:
+    struct phase_time
+    {
+        double wall{ 0 };
+        double cpu{ 0 };
+    };
+    std::array<std::atomic<u64>, 3> classified{};
+    std::atomic<u64> hole_blocks{ 0 };
+    std::array<phase_time, phase_count> phases{};
+    double wall_mark;
+    double cpu_mark;
+};
+
+// Charges the time up to its construction to a phase, for timing member
+// initialisers in declaration order
+struct phase_lap
+{
+    phase_lap(recovery_stats& stats, recovery_phase phase) noexcept
+    {
+        stats.lap(phase);
+    }
+};
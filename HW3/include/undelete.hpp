@@ -0,0 +1,64 @@
+#pragma once
+
+#include "block_set.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+#include "recovery_stats.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class undelete_outcome
+{
+    recovered,     /* contents written to the output directory */
+    not_a_file,    /* only regular files are extracted */
+    no_blocks,     /* the pointers were cleared on deletion */
+    blocks_reused, /* a live inode owns one of its blocks now */
+    write_failed,  /* the output file could not be written */
+};
+
+struct undelete_result
+{
+    std::uint32_t inode;
+    std::uint64_t size;
+    undelete_outcome outcome;
+};
+
+// Extracts deleted regular files whose blocks no live inode has taken
+// since. A deleted inode keeps its pointers in ext2, so its contents can be
+// copied from the image as long as every block it points at, indirect ones
+// included, is still free. Copies go image to file with copy_file_range and
+// do not pass through user space. Groups are independent, scan_group may
+// run for several groups at once.
+class undelete_scanner
+{
+   public:
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    // used holds the blocks of every live inode and all group metadata
+    undelete_scanner(const mapped_image& image,
+                     const geometry& geo,
+                     const block_set& used,
+                     std::string directory,
+                     io_counters* counters = nullptr) noexcept;
+
+    // Results for every deleted inode of the group, by inode number
+    std::vector<undelete_result> scan_group(u32 bg_num) const noexcept;
+
+    // Name of the file an inode is extracted to
+    std::string output_path(u32 ino) const;
+
+   private:
+    const mapped_image& image;
+    const geometry& geo;
+    const block_set& used;
+    std::string directory;
+    io_counters* counters;
+
+    bool blocks_free(const ext2_inode& inode, u64& data_blocks) const noexcept;
+    bool extract(u32 ino, const ext2_inode& inode) const noexcept;
+    bool copy_run(int out, u64 from, u64 to, u64 length) const noexcept;
+};
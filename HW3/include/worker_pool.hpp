@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <latch>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads draining a shared task queue
+class worker_pool
+{
+   public:
+    using u32 = std::uint32_t;
+
+    explicit worker_pool(unsigned threads) noexcept;
+    ~worker_pool() noexcept;
+
+    worker_pool(const worker_pool&) = delete;
+    worker_pool(worker_pool&&) = delete;
+
+    worker_pool& operator=(const worker_pool&) = delete;
+    worker_pool& operator=(worker_pool&&) = delete;
+
+    void submit(std::function<void()> task) noexcept;
+
+    // Runs job(i) for every i in [0, count) and waits for all of them. Only
+    // waits for its own jobs, so several threads may call it at once on a
+    // shared pool; it must not be called from a job.
+    template<typename Job>
+    void for_each(u32 count, Job&& job) noexcept
+    {
+        std::latch finished{ count };
+        for (u32 i{ 0 }; i < count; ++i)
+        {
+            submit(
+              [&job, &finished, i]
+              {
+                  job(i);
+                  finished.count_down();
+              });
+        }
+        finished.wait();
+    }
+
+    unsigned size() const noexcept { return workers.size(); }
+
+   private:
+    std::mutex lock;
+    std::condition_variable task_ready;
+    std::queue<std::function<void()>> tasks;
+    bool stopping{ false };
+    std::vector<std::jthread> workers;
+
+    void work() noexcept;
+};
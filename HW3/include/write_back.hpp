@@ -0,0 +1,74 @@
+#pragma once
+
+#include "mapped_image.hpp"
+#include "recovery_stats.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// In-memory set of modified blocks. Recovery stages whole blocks or single
+// fields here instead of writing into the image, and flush() writes them out
+// in ascending order with one pwritev per run of consecutive blocks. Staged
+// blocks that ended up identical to the image are neither written nor
+// counted.
+class write_back
+{
+   public:
+    using u8 = std::uint8_t;
+    using u32 = std::uint32_t;
+    using u64 = std::uint64_t;
+
+    write_back(const mapped_image& image,
+               u64 block_size,
+               io_counters* counters = nullptr) noexcept;
+
+    // Replaces the whole block
+    void stage(u32 b_num, std::span<const u8> data) noexcept;
+    // Staged copy of the block, taken from the image on first use
+    std::span<u8> edit(u32 b_num) noexcept;
+    // Staged copy if there is one, the image otherwise
+    std::span<const u8> view(u32 b_num) const noexcept;
+
+    template<typename T>
+    T read(u64 offset) const noexcept
+    {
+        T value;
+        std::memcpy(&value,
+                    view(block_of(offset)).data() + offset % block_size,
+                    sizeof(T));
+        return value;
+    }
+    template<typename T>
+    void write(u64 offset, const T& value) noexcept
+    {
+        std::memcpy(edit(block_of(offset)).data() + offset % block_size,
+                    &value,
+                    sizeof(T));
+    }
+
+    // Written blocks are dropped from the set. Returns false when a write
+    // failed, in which case everything stays staged.
+    bool flush() noexcept;
+    // Waits until flushed blocks are on stable storage
+    bool sync() const noexcept;
+
+    // Staged blocks that differ from the image
+    u64 dirty_blocks() const noexcept;
+
+   private:
+    const mapped_image& image;
+    u64 block_size;
+    mutable std::mutex lock;
+    std::map<u32, std::vector<u8>> dirty;
+    io_counters* counters;
+
+    bool unchanged(u32 b_num, const std::vector<u8>& data) const noexcept;
+    u32 block_of(u64 offset) const noexcept
+    {
+        return static_cast<u32>(offset / block_size);
+    }
+};
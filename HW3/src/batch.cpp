@@ -0,0 +1,197 @@
+#include "batch.hpp"
+
+#include "options.hpp"
+#include "recext2fs.hpp"
+#include "recovery_stats.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+struct manifest_entry
+{
+    std::string image;
+    std::vector<u8> identifier;
+};
+
+struct image_result
+{
+    bool ok{ false };
+    recovery_stats stats;
+};
+
+bool read_manifest(const std::string& path,
+                   std::vector<manifest_entry>& entries)
+{
+    std::ifstream in{ path };
+    if (!in)
+    {
+        std::cerr << "Could not open the manifest: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (u32 number{ 1 }; std::getline(in, line); ++number)
+    {
+        std::istringstream fields{ line };
+        std::vector<std::string> words;
+        for (std::string word; fields >> word;)
+        {
+            words.emplace_back(std::move(word));
+        }
+        if (words.empty() || words[0].starts_with('#'))
+        {
+            continue;
+        }
+        if (words.size() < 2)
+        {
+            std::cerr << path << ":" << number
+                      << ": expected an image and its identifier" << std::endl;
+            return false;
+        }
+        std::vector<std::string_view> const bytes(words.begin() + 1,
+                                                  words.end());
+        entries.push_back(
+          { words[0], options::parse_identifier(bytes) });
+    }
+    if (entries.empty())
+    {
+        std::cerr << "No images in the manifest: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void write_batch_stats(std::ostream& out,
+                       const options& opts,
+                       const std::vector<manifest_entry>& entries,
+                       const std::vector<image_result>& results,
+                       double wall)
+{
+    recovery_stats total;
+    u64 failed{ 0 };
+    for (image_result const& result : results)
+    {
+        total.add(result.stats);
+        failed += result.ok ? 0 : 1;
+    }
+    // per-image phase times add up to more than the wall time when images
+    // overlap, "wall" is the time the whole batch took
+    out << "{\"wall\":" << wall << ",\"images\":" << results.size()
+        << ",\"failed\":" << failed << ",\"total\":";
+    total.write_json(out, opts.batch_path, opts.threads);
+    out << ",\"per_image\":[";
+    for (std::size_t i{ 0 }; i < results.size(); ++i)
+    {
+        out << (i == 0 ? "" : ",");
+        results[i].stats.write_json(out, entries[i].image, opts.threads);
+    }
+    out << "]}" << std::endl;
+}
+} // namespace
+
+bool recover_batch(const options& opts, worker_pool& pool) noexcept
+{
+    auto const start{ std::chrono::steady_clock::now() };
+    std::vector<manifest_entry> entries;
+    if (!read_manifest(opts.batch_path, entries))
+    {
+        return false;
+    }
+
+    std::vector<image_result> results(entries.size());
+    std::atomic<std::size_t> next{ 0 };
+    std::mutex output;
+    auto const drive{ [&]
+                      {
+                          for (std::size_t i{ next.fetch_add(1) };
+                               i < entries.size();
+                               i = next.fetch_add(1))
+                          {
+                              options image_opts{ opts };
+                              image_opts.batch_path.clear();
+                              image_opts.stats_path.clear();
+                              image_opts.print_metadata = false;
+                              image_opts.image_location = entries[i].image;
+                              image_opts.data_identifier =
+                                entries[i].identifier;
+                              // held back until the image is done so its
+                              // lines stay together
+                              std::ostringstream report;
+                              try
+                              {
+                                  recext2fs fs{ std::move(image_opts),
+                                                pool,
+                                                report };
+                                  results[i].ok = fs.recover_bitmap();
+                                  results[i].stats.add(fs.statistics());
+                              }
+                              catch (const std::exception&)
+                              {
+                                  // the image reported why it failed to open
+                              }
+                              std::scoped_lock guard{ output };
+                              std::istringstream lines{ report.str() };
+                              for (std::string line;
+                                   std::getline(lines, line);)
+                              {
+                                  std::cout << entries[i].image << ": "
+                                            << line << std::endl;
+                              }
+                              std::cout << entries[i].image << ": "
+                                        << (results[i].ok ? "ok" : "failed")
+                                        << std::endl;
+                          }
+                      } };
+
+    // one driver per image in flight; drivers only run the serial parts of a
+    // recovery and hand their group work to the pool
+    {
+        std::size_t const drivers{ std::min<std::size_t>(entries.size(),
+                                                         pool.size()) };
+        std::vector<std::jthread> threads;
+        for (std::size_t i{ 0 }; i < drivers; ++i)
+        {
+            threads.emplace_back(drive);
+        }
+    }
+
+    double const wall{ std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count() };
+    bool const ok{ std::all_of(results.begin(),
+                               results.end(),
+                               [](const image_result& r) { return r.ok; }) };
+    if (opts.stats_path == "-")
+    {
+        write_batch_stats(std::cout, opts, entries, results, wall);
+    }
+    else if (!opts.stats_path.empty())
+    {
+        std::ofstream out{ opts.stats_path };
+        write_batch_stats(out, opts, entries, results, wall);
+        if (!out)
+        {
+            std::cerr << "Could not write statistics to " << opts.stats_path
+                      << std::endl;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,128 @@
+#include "bit_count.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BIT_COUNT_X86
+#endif
+
+using u8 = std::uint8_t;
+using u64 = std::uint64_t;
+using size_t = std::size_t;
+
+namespace
+{
+u64 load_word(const u8* data) noexcept
+{
+    u64 word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+u64 count_words_portable(const u8* data, size_t words) noexcept
+{
+    u64 total{ 0 };
+    for (size_t i{ 0 }; i < words; ++i)
+    {
+        total += std::popcount(load_word(data + i * sizeof(u64)));
+    }
+    return total;
+}
+
+#ifdef BIT_COUNT_X86
+__attribute__((target("popcnt"))) u64 count_words_popcnt(const u8* data,
+                                                         size_t words) noexcept
+{
+    u64 total{ 0 };
+    for (size_t i{ 0 }; i < words; ++i)
+    {
+        total += static_cast<u64>(
+          _mm_popcnt_u64(load_word(data + i * sizeof(u64))));
+    }
+    return total;
+}
+
+__attribute__((target("avx2,popcnt"))) u64 count_words_avx2(
+  const u8* data,
+  size_t words) noexcept
+{
+    // per-nibble counts looked up with a byte shuffle, summed with sad
+    __m256i const lookup{ _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4) };
+    __m256i const low_mask{ _mm256_set1_epi8(0x0f) };
+    __m256i sums{ _mm256_setzero_si256() };
+    size_t i{ 0 };
+    for (; i + 4 <= words; i += 4)
+    {
+        __m256i const v{ _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(data + i * sizeof(u64))) };
+        __m256i const low{ _mm256_shuffle_epi8(
+          lookup, _mm256_and_si256(v, low_mask)) };
+        __m256i const high{ _mm256_shuffle_epi8(
+          lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask)) };
+        sums = _mm256_add_epi64(
+          sums,
+          _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+    }
+    u64 total{ static_cast<u64>(_mm256_extract_epi64(sums, 0)) +
+               static_cast<u64>(_mm256_extract_epi64(sums, 1)) +
+               static_cast<u64>(_mm256_extract_epi64(sums, 2)) +
+               static_cast<u64>(_mm256_extract_epi64(sums, 3)) };
+    return total + count_words_popcnt(data + i * sizeof(u64), words - i);
+}
+#endif
+
+struct kernel
+{
+    u64 (*count_words)(const u8*, size_t) noexcept;
+    const char* name;
+};
+
+kernel select_kernel() noexcept
+{
+#ifdef BIT_COUNT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        return { count_words_avx2, "avx2" };
+    }
+    if (__builtin_cpu_supports("popcnt"))
+    {
+        return { count_words_popcnt, "popcnt" };
+    }
+#endif
+    return { count_words_portable, "portable" };
+}
+
+kernel const selected{ select_kernel() };
+} // namespace
+
+u64 count_set_bits(std::span<const u8> bitmap, u64 bit_count) noexcept
+{
+    size_t const bytes{ static_cast<size_t>(bit_count / 8) };
+    size_t const words{ bytes / sizeof(u64) };
+    u64 total{ selected.count_words(bitmap.data(), words) };
+    for (size_t i{ words * sizeof(u64) }; i < bytes; ++i)
+    {
+        total += std::popcount(bitmap[i]);
+    }
+    // the last partial byte only counts its low bits
+    if (bit_count % 8 != 0)
+    {
+        u8 const mask{ static_cast<u8>((1U << (bit_count % 8)) - 1) };
+        total += std::popcount(static_cast<u8>(bitmap[bytes] & mask));
+    }
+    return total;
+}
+
+const char* bit_count_isa() noexcept
+{
+    return selected.name;
+}
@@ -0,0 +1,242 @@
+#include "bit_diff.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BIT_DIFF_X86
+#endif
+
+using u8 = std::uint8_t;
+using u64 = std::uint64_t;
+using size_t = std::size_t;
+
+namespace
+{
+size_t tail_difference(const u8* lhs,
+                       const u8* rhs,
+                       size_t from,
+                       size_t size) noexcept
+{
+    return static_cast<size_t>(
+      std::mismatch(lhs + from, lhs + size, rhs + from).first - lhs);
+}
+
+#ifndef BIT_DIFF_X86
+size_t first_difference_scalar(const u8* lhs,
+                               const u8* rhs,
+                               size_t from,
+                               size_t size) noexcept
+{
+    size_t i{ from };
+    for (; i + sizeof(u64) <= size; i += sizeof(u64))
+    {
+        u64 a;
+        u64 b;
+        std::memcpy(&a, lhs + i, sizeof(a));
+        std::memcpy(&b, rhs + i, sizeof(b));
+        if ((a ^ b) != 0)
+        {
+            break;
+        }
+    }
+    return tail_difference(lhs, rhs, i, size);
+}
+#else
+__attribute__((target("sse2"))) size_t first_difference_sse2(
+  const u8* lhs,
+  const u8* rhs,
+  size_t from,
+  size_t size) noexcept
+{
+    size_t i{ from };
+    for (; i + 64 <= size; i += 64)
+    {
+        auto const* a{ reinterpret_cast<const __m128i*>(lhs + i) };
+        auto const* b{ reinterpret_cast<const __m128i*>(rhs + i) };
+        __m128i const acc{ _mm_or_si128(
+          _mm_or_si128(
+            _mm_xor_si128(_mm_loadu_si128(a), _mm_loadu_si128(b)),
+            _mm_xor_si128(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1))),
+          _mm_or_si128(
+            _mm_xor_si128(_mm_loadu_si128(a + 2), _mm_loadu_si128(b + 2)),
+            _mm_xor_si128(_mm_loadu_si128(a + 3), _mm_loadu_si128(b + 3)))) };
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) !=
+            0xffff)
+        {
+            break;
+        }
+    }
+    return tail_difference(lhs, rhs, i, size);
+}
+
+__attribute__((target("avx2"))) size_t first_difference_avx2(
+  const u8* lhs,
+  const u8* rhs,
+  size_t from,
+  size_t size) noexcept
+{
+    size_t i{ from };
+    for (; i + 128 <= size; i += 128)
+    {
+        auto const* a{ reinterpret_cast<const __m256i*>(lhs + i) };
+        auto const* b{ reinterpret_cast<const __m256i*>(rhs + i) };
+        __m256i const acc{ _mm256_or_si256(
+          _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(a),
+                                           _mm256_loadu_si256(b)),
+                          _mm256_xor_si256(_mm256_loadu_si256(a + 1),
+                                           _mm256_loadu_si256(b + 1))),
+          _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(a + 2),
+                                           _mm256_loadu_si256(b + 2)),
+                          _mm256_xor_si256(_mm256_loadu_si256(a + 3),
+                                           _mm256_loadu_si256(b + 3)))) };
+        if (!_mm256_testz_si256(acc, acc))
+        {
+            break;
+        }
+    }
+    return tail_difference(lhs, rhs, i, size);
+}
+
+__attribute__((target("avx512f"))) size_t first_difference_avx512(
+  const u8* lhs,
+  const u8* rhs,
+  size_t from,
+  size_t size) noexcept
+{
+    size_t i{ from };
+    for (; i + 256 <= size; i += 256)
+    {
+        auto const* a{ reinterpret_cast<const __m512i*>(lhs + i) };
+        auto const* b{ reinterpret_cast<const __m512i*>(rhs + i) };
+        __m512i const acc{ _mm512_or_si512(
+          _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(a),
+                                           _mm512_loadu_si512(b)),
+                          _mm512_xor_si512(_mm512_loadu_si512(a + 1),
+                                           _mm512_loadu_si512(b + 1))),
+          _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(a + 2),
+                                           _mm512_loadu_si512(b + 2)),
+                          _mm512_xor_si512(_mm512_loadu_si512(a + 3),
+                                           _mm512_loadu_si512(b + 3)))) };
+        if (_mm512_test_epi64_mask(acc, acc) != 0)
+        {
+            break;
+        }
+    }
+    return tail_difference(lhs, rhs, i, size);
+}
+#endif
+
+struct kernel
+{
+    size_t (*first_difference)(const u8*, const u8*, size_t, size_t) noexcept;
+    const char* name;
+};
+
+kernel select_kernel() noexcept
+{
+#ifdef BIT_DIFF_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return { first_difference_avx512, "avx512" };
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return { first_difference_avx2, "avx2" };
+    }
+    return { first_difference_sse2, "sse2" };
+#else
+    return { first_difference_scalar, "scalar" };
+#endif
+}
+
+kernel const selected{ select_kernel() };
+} // namespace
+
+std::vector<bit_range> differing_bits(std::span<const u8> lhs,
+                                      std::span<const u8> rhs,
+                                      u64 bit_count) noexcept
+{
+    std::vector<bit_range> ranges;
+    std::span<const u8> const a{ lhs.first(
+      std::min<u64>(lhs.size(), (bit_count + 7) / 8)) };
+    std::span<const u8> const b{ rhs.first(
+      std::min<u64>(rhs.size(), (bit_count + 7) / 8)) };
+    for (u64 base{ 0 }; base < bit_count; base += 64)
+    {
+        // jump over identical stretches, then XOR one word at a time
+        u64 const next{ first_difference(a, b, base / 8) };
+        base = next / 8 * 64;
+        if (base >= bit_count)
+        {
+            break;
+        }
+        u64 diff{ load_word(a, base / 8) ^ load_word(b, base / 8) };
+        if (bit_count - base < 64)
+        {
+            diff &= (u64{ 1 } << (bit_count - base)) - 1;
+        }
+        append_bits(ranges, diff, base);
+    }
+    return ranges;
+}
+
+u64 load_word(std::span<const u8> bitmap, u64 from_byte) noexcept
+{
+    u64 word{ 0 };
+    if (from_byte < bitmap.size())
+    {
+        std::memcpy(&word,
+                    bitmap.data() + from_byte,
+                    std::min<u64>(sizeof(word), bitmap.size() - from_byte));
+    }
+    return word;
+}
+
+void append_range(std::vector<bit_range>& ranges, u64 first, u64 end)
+{
+    if (!ranges.empty() && ranges.back().end == first)
+    {
+        ranges.back().end = end;
+        return;
+    }
+    ranges.push_back({ first, end });
+}
+
+void append_bits(std::vector<bit_range>& ranges, u64 word, u64 base)
+{
+    // peel off one run of set bits at a time
+    while (word != 0)
+    {
+        u64 const start{ static_cast<u64>(std::countr_zero(word)) };
+        u64 const length{ static_cast<u64>(std::countr_one(word >> start)) };
+        append_range(ranges, base + start, base + start + length);
+        word = start + length >= 64
+                 ? 0
+                 : word & ~((u64{ 1 } << (start + length)) - 1);
+    }
+}
+
+u64 first_difference(std::span<const u8> lhs,
+                     std::span<const u8> rhs,
+                     u64 from) noexcept
+{
+    size_t const size{ std::min(lhs.size(), rhs.size()) };
+    if (from >= size)
+    {
+        return size;
+    }
+    return selected.first_difference(lhs.data(), rhs.data(), from, size);
+}
+
+const char* bit_diff_isa() noexcept
+{
+    return selected.name;
+}
@@ -0,0 +1,274 @@
+#include "block_classifier.hpp"
+
+#include "block_size.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLOCK_CLASSIFIER_X86
+#endif
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+using size_t = std::size_t;
+
+namespace
+{
+bool tail_is_zero(const u8* data, size_t from, size_t size) noexcept
+{
+    return std::all_of(
+      data + from, data + size, [](u8 byte) { return byte == 0; });
+}
+
+#ifdef BLOCK_CLASSIFIER_X86
+template<u64 Size>
+__attribute__((target("sse2"))) bool is_zero_sse2(const u8* data,
+                                                  size_t runtime) noexcept
+{
+    size_t const size{ fixed_block_size<Size>(runtime) };
+    size_t i{ 0 };
+    for (; i + 64 <= size; i += 64)
+    {
+        auto const* p{ reinterpret_cast<const __m128i*>(data + i) };
+        __m128i const acc{ _mm_or_si128(
+          _mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+          _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3))) };
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) !=
+            0xffff)
+        {
+            return false;
+        }
+    }
+    return tail_is_zero(data, i, size);
+}
+
+template<u64 Size>
+__attribute__((target("avx2"))) bool is_zero_avx2(const u8* data,
+                                                  size_t runtime) noexcept
+{
+    size_t const size{ fixed_block_size<Size>(runtime) };
+    size_t i{ 0 };
+    for (; i + 128 <= size; i += 128)
+    {
+        auto const* p{ reinterpret_cast<const __m256i*>(data + i) };
+        __m256i const acc{ _mm256_or_si256(
+          _mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+          _mm256_or_si256(_mm256_loadu_si256(p + 2),
+                          _mm256_loadu_si256(p + 3))) };
+        if (!_mm256_testz_si256(acc, acc))
+        {
+            return false;
+        }
+    }
+    return tail_is_zero(data, i, size);
+}
+
+template<u64 Size>
+__attribute__((target("avx512f"))) bool is_zero_avx512(const u8* data,
+                                                       size_t runtime) noexcept
+{
+    size_t const size{ fixed_block_size<Size>(runtime) };
+    size_t i{ 0 };
+    for (; i + 256 <= size; i += 256)
+    {
+        auto const* p{ reinterpret_cast<const __m512i*>(data + i) };
+        __m512i const acc{ _mm512_or_si512(
+          _mm512_or_si512(_mm512_loadu_si512(p), _mm512_loadu_si512(p + 1)),
+          _mm512_or_si512(_mm512_loadu_si512(p + 2),
+                          _mm512_loadu_si512(p + 3))) };
+        if (_mm512_test_epi64_mask(acc, acc) != 0)
+        {
+            return false;
+        }
+    }
+    return tail_is_zero(data, i, size);
+}
+
+template<u64 BlockSize>
+__attribute__((target("avx2"))) u64 prefilter_avx2(const u8* chunk,
+                                                   u64 runtime,
+                                                   u32 count,
+                                                   u64 word,
+                                                   u64 mask) noexcept
+{
+    u64 const block_size{ fixed_block_size<BlockSize>(runtime) };
+    __m256i const stride{ _mm256_set_epi64x(static_cast<long long>(
+                                              3 * block_size),
+                                            static_cast<long long>(
+                                              2 * block_size),
+                                            static_cast<long long>(block_size),
+                                            0) };
+    __m256i const wanted{ _mm256_set1_epi64x(static_cast<long long>(word)) };
+    __m256i const keep{ _mm256_set1_epi64x(static_cast<long long>(mask)) };
+    u64 hits{ 0 };
+    u32 i{ 0 };
+    for (; i + 4 <= count; i += 4)
+    {
+        // first word of four consecutive blocks in one gather
+        __m256i const heads{ _mm256_i64gather_epi64(
+          reinterpret_cast<const long long*>(chunk + i * block_size),
+          stride,
+          1) };
+        __m256i const equal{ _mm256_cmpeq_epi64(
+          _mm256_and_si256(heads, keep), wanted) };
+        hits |= static_cast<u64>(
+                  _mm256_movemask_pd(_mm256_castsi256_pd(equal)))
+                << i;
+    }
+    for (; i < count; ++i)
+    {
+        u64 head{ 0 };
+        std::memcpy(&head, chunk + i * block_size, sizeof(head));
+        hits |= static_cast<u64>((head & mask) == word) << i;
+    }
+    return hits;
+}
+#endif
+
+template<u64 Size>
+bool is_zero_scalar(const u8* data, size_t runtime) noexcept
+{
+    return tail_is_zero(data, 0, fixed_block_size<Size>(runtime));
+}
+
+template<u64 BlockSize>
+u64 prefilter_scalar(const u8* chunk,
+                     u64 runtime,
+                     u32 count,
+                     u64 word,
+                     u64 mask) noexcept
+{
+    u64 const block_size{ fixed_block_size<BlockSize>(runtime) };
+    u64 hits{ 0 };
+    for (u32 i{ 0 }; i < count; ++i)
+    {
+        u64 head{ 0 };
+        std::memcpy(&head, chunk + i * block_size, sizeof(head));
+        hits |= static_cast<u64>((head & mask) == word) << i;
+    }
+    return hits;
+}
+
+struct kernel
+{
+    bool (*is_zero)(const u8*, size_t) noexcept;
+    u64 (*prefilter)(const u8*, u64, u32, u64, u64) noexcept;
+    const char* name;
+};
+
+template<u64 BlockSize>
+kernel select_kernel() noexcept
+{
+#ifdef BLOCK_CLASSIFIER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return { is_zero_avx512<BlockSize>,
+                 prefilter_avx2<BlockSize>,
+                 "avx512" };
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return { is_zero_avx2<BlockSize>, prefilter_avx2<BlockSize>, "avx2" };
+    }
+    return { is_zero_sse2<BlockSize>, prefilter_scalar<BlockSize>, "sse2" };
+#else
+    return { is_zero_scalar<BlockSize>,
+             prefilter_scalar<BlockSize>,
+             "scalar" };
+#endif
+}
+
+// one kernel per specialised block size, 0 takes the size at runtime
+template<u64 BlockSize>
+kernel const selected{ select_kernel<BlockSize>() };
+} // namespace
+
+bool has_identifier(std::span<const u8> block,
+                    std::span<const u8> identifier) noexcept
+{
+    return !identifier.empty() && identifier.size() <= block.size() &&
+           std::memcmp(block.data(), identifier.data(), identifier.size()) ==
+             0;
+}
+
+template<u64 BlockSize>
+block_class classify_block(std::span<const u8> block,
+                           std::span<const u8> identifier) noexcept
+{
+    if (has_identifier(block, identifier))
+    {
+        return block_class::identifier;
+    }
+    return selected<BlockSize>.is_zero(block.data(), block.size())
+             ? block_class::empty
+             : block_class::nonzero;
+}
+
+block_class classify_block(std::span<const u8> block,
+                           std::span<const u8> identifier) noexcept
+{
+    return classify_block<0>(block, identifier);
+}
+
+block_class classify_block_scalar(std::span<const u8> block,
+                                  std::span<const u8> identifier) noexcept
+{
+    if (has_identifier(block, identifier))
+    {
+        return block_class::identifier;
+    }
+    return is_zero_scalar<0>(block.data(), block.size())
+             ? block_class::empty
+             : block_class::nonzero;
+}
+
+template<u64 BlockSize>
+u64 identifier_prefilter(const u8* chunk,
+                         u64 block_size,
+                         u32 count,
+                         std::span<const u8> identifier) noexcept
+{
+    if (identifier.empty())
+    {
+        return 0;
+    }
+    u64 word{ 0 };
+    u64 mask{ 0 };
+    size_t const prefix{ std::min(identifier.size(), sizeof(u64)) };
+    std::memcpy(&word, identifier.data(), prefix);
+    std::memset(&mask, 0xff, prefix);
+    return selected<BlockSize>.prefilter(
+      chunk, block_size, count, word, mask);
+}
+
+u64 identifier_prefilter(const u8* chunk,
+                         u64 block_size,
+                         u32 count,
+                         std::span<const u8> identifier) noexcept
+{
+    return identifier_prefilter<0>(chunk, block_size, count, identifier);
+}
+
+#define BLOCK_CLASSIFIER_INSTANTIATE(size)                                    \
+    template block_class classify_block<size>(                                \
+      std::span<const u8>, std::span<const u8>) noexcept;                     \
+    template u64 identifier_prefilter<size>(                                  \
+      const u8*, u64, u32, std::span<const u8>) noexcept;
+BLOCK_CLASSIFIER_INSTANTIATE(0)
+BLOCK_CLASSIFIER_INSTANTIATE(1024)
+BLOCK_CLASSIFIER_INSTANTIATE(2048)
+BLOCK_CLASSIFIER_INSTANTIATE(4096)
+BLOCK_CLASSIFIER_INSTANTIATE(8192)
+#undef BLOCK_CLASSIFIER_INSTANTIATE
+
+const char* block_classifier_isa() noexcept
+{
+    return selected<0>.name;
+}
@@ -0,0 +1,145 @@
+#include "block_scanner.hpp"
+
+#include "recovery_stats.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+using u8 = std::uint8_t;
+using u64 = std::uint64_t;
+
+block_scanner::block_scanner(int fd,
+                             u64 block_size,
+                             u64 chunk_size,
+                             io_counters* counters) noexcept
+  : fd{ fd }
+  , block_size{ block_size }
+  , buffer(std::max(chunk_size / block_size, u64{ 1 }) * block_size)
+  , counters{ counters }
+{
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+bool block_scanner::read_chunk(u64 offset, u64 length) noexcept
+{
+    u64 done{ 0 };
+    while (done < length)
+    {
+        ssize_t const got{ pread(fd,
+                                 buffer.data() + done,
+                                 length - done,
+                                 static_cast<off_t>(offset + done)) };
+        if (counters != nullptr)
+        {
+            counters->add_read(got > 0 ? static_cast<u64>(got) : 0);
+        }
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "pread failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (got == 0)
+        {
+            // past the end of the image, the rest reads as zeros
+            std::fill(buffer.begin() + static_cast<long>(done),
+                      buffer.begin() + static_cast<long>(length),
+                      0);
+            break;
+        }
+        done += static_cast<u64>(got);
+    }
+    return true;
+}
+
+block_scanner::block_range block_scanner::next_data(u64 offset,
+                                                    u64 first,
+                                                    u64 block_count) noexcept
+{
+    u64 const from{ offset + first * block_size };
+    u64 start{ from };
+    u64 end{ offset + block_count * block_size };
+    bool found{ true };
+    if (counters != nullptr && query != extent_query::none)
+    {
+        counters->add_read(0);
+    }
+    if (query == extent_query::seek)
+    {
+        found = seek_data(from, start, end);
+    }
+    if (query == extent_query::fiemap)
+    {
+        found = fiemap_data(from, start, end);
+    }
+    if (query == extent_query::none)
+    {
+        return { first, block_count };
+    }
+    // round outwards so a block is only skipped when it is all hole
+    u64 const data_first{ std::max(first, (start - offset) / block_size) };
+    if (!found || data_first >= block_count)
+    {
+        return { block_count, block_count };
+    }
+    u64 const data_end{ end >= offset + block_count * block_size
+                          ? block_count
+                          : (end - offset + block_size - 1) / block_size };
+    return { data_first, std::max(data_end, data_first + 1) };
+}
+
+bool block_scanner::seek_data(u64 from, u64& start, u64& end) noexcept
+{
+    off_t const data{ lseek(fd, static_cast<off_t>(from), SEEK_DATA) };
+    if (data < 0)
+    {
+        if (errno != ENXIO)
+        {
+            // not supported here, FIEMAP may still work
+            query = extent_query::fiemap;
+        }
+        return false;
+    }
+    off_t const hole{ lseek(fd, data, SEEK_HOLE) };
+    start = static_cast<u64>(data);
+    // the end of file counts as a hole, so this only fails on a race
+    end = hole < 0 ? std::numeric_limits<u64>::max() : static_cast<u64>(hole);
+    return true;
+}
+
+bool block_scanner::fiemap_data(u64 from, u64& start, u64& end) noexcept
+{
+    // room for the header and a single extent
+    alignas(fiemap) std::array<u8, sizeof(fiemap) + sizeof(fiemap_extent)>
+      request{};
+    auto* map{ reinterpret_cast<fiemap*>(request.data()) };
+    map->fm_start = from;
+    map->fm_length = FIEMAP_MAX_OFFSET - from;
+    map->fm_flags = FIEMAP_FLAG_SYNC;
+    map->fm_extent_count = 1;
+    if (ioctl(fd, FS_IOC_FIEMAP, map) < 0)
+    {
+        query = extent_query::none;
+        return true;
+    }
+    if (map->fm_mapped_extents == 0)
+    {
+        return false;
+    }
+    fiemap_extent const& extent{ map->fm_extents[0] };
+    start = std::max(from, static_cast<u64>(extent.fe_logical));
+    end = extent.fe_logical + extent.fe_length;
+    return true;
+}
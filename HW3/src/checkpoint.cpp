@@ -0,0 +1,182 @@
+#include "checkpoint.hpp"
+
+#include "block_set.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+constexpr u64 checkpoint_magic{ 0x31504b4332545845ULL }; // "EXT2CKP1"
+
+struct header
+{
+    u64 magic;
+    checkpoint::identity image;
+    u32 reserved;
+};
+
+bool write_all(int fd, const u8* data, u64 size) noexcept
+{
+    while (size > 0)
+    {
+        ssize_t const done{ write(fd, data, size) };
+        if (done < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += done;
+        size -= static_cast<u64>(done);
+    }
+    return true;
+}
+
+bool read_all(int fd, u8* data, u64 size) noexcept
+{
+    while (size > 0)
+    {
+        ssize_t const done{ read(fd, data, size) };
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            return false;
+        }
+        data += done;
+        size -= static_cast<u64>(done);
+    }
+    return true;
+}
+
+std::string parent_directory(const std::string& path)
+{
+    auto const slash{ path.rfind('/') };
+    if (slash == std::string::npos)
+    {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+} // namespace
+
+checkpoint::checkpoint(std::string path, identity image) noexcept
+  : path{ std::move(path) }
+  , image{ image }
+  , finished{ image.group_count }
+{
+}
+
+bool checkpoint::load() noexcept
+{
+    int const fd{ open(path.c_str(), O_RDONLY) };
+    if (fd < 0)
+    {
+        return false;
+    }
+    header stored{};
+    std::vector<u8> groups((image.group_count + 7) / 8, 0);
+    bool const ok{
+        read_all(fd, reinterpret_cast<u8*>(&stored), sizeof(stored)) &&
+        stored.magic == checkpoint_magic &&
+        std::memcmp(&stored.image, &image, sizeof(image)) == 0 &&
+        read_all(fd, groups.data(), groups.size())
+    };
+    close(fd);
+    if (!ok)
+    {
+        std::cerr << "Ignoring checkpoint " << path
+                  << ": it does not belong to this image" << std::endl;
+        return false;
+    }
+    for (u32 g{ 0 }; g < image.group_count; ++g)
+    {
+        if ((groups[g / 8] >> (g % 8)) & 1U)
+        {
+            finished.set(g);
+        }
+    }
+    return true;
+}
+
+bool checkpoint::save() const noexcept
+{
+    // the padding goes to disk as well, so zero every byte before filling in
+    // the fields; identical runs then write identical files
+    header stored;
+    std::memset(&stored, 0, sizeof(stored));
+    stored.magic = checkpoint_magic;
+    stored.image = image;
+    std::vector<u8> groups((image.group_count + 7) / 8, 0);
+    for (u32 g{ 0 }; g < image.group_count; ++g)
+    {
+        if (finished.test(g))
+        {
+            groups[g / 8] |= static_cast<u8>(1U << (g % 8));
+        }
+    }
+
+    std::string const temporary{ path + ".tmp" };
+    int const fd{ open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+    if (fd < 0)
+    {
+        std::cerr << "Could not create " << temporary << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    bool ok{
+        write_all(fd, reinterpret_cast<const u8*>(&stored), sizeof(stored)) &&
+        write_all(fd, groups.data(), groups.size()) && fsync(fd) == 0
+    };
+    ok = close(fd) == 0 && ok;
+    // the rename is the commit point, syncing the directory makes it stick
+    ok = ok && std::rename(temporary.c_str(), path.c_str()) == 0;
+    if (ok)
+    {
+        int const dir{ open(parent_directory(path).c_str(), O_RDONLY) };
+        if (dir >= 0)
+        {
+            fsync(dir);
+            close(dir);
+        }
+    }
+    else
+    {
+        std::cerr << "Could not save checkpoint " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        unlink(temporary.c_str());
+    }
+    return ok;
+}
+
+void checkpoint::remove() const noexcept
+{
+    unlink(path.c_str());
+}
+
+u32 checkpoint::done_count() const noexcept
+{
+    u32 count{ 0 };
+    for (u32 g{ 0 }; g < image.group_count; ++g)
+    {
+        count += finished.test(g);
+    }
+    return count;
+}
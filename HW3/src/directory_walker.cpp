@@ -0,0 +1,177 @@
+#include "directory_walker.hpp"
+
+#include "block_set.hpp"
+#include "ext2_ranges.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+#include "worker_pool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+// Directories waiting to be read by one worker
+struct work_queue
+{
+    std::mutex lock;
+    std::deque<u32> directories;
+};
+
+bool pop_front(work_queue& queue, u32& ino) noexcept
+{
+    std::scoped_lock guard{ queue.lock };
+    if (queue.directories.empty())
+    {
+        return false;
+    }
+    ino = queue.directories.front();
+    queue.directories.pop_front();
+    return true;
+}
+
+bool steal_back(work_queue& queue, u32& ino) noexcept
+{
+    std::scoped_lock guard{ queue.lock };
+    if (queue.directories.empty())
+    {
+        return false;
+    }
+    ino = queue.directories.back();
+    queue.directories.pop_back();
+    return true;
+}
+} // namespace
+
+directory_walker::directory_walker(const mapped_image& image,
+                                   const geometry& geo) noexcept
+  : image{ image }
+  , geo{ geo }
+  , inodes{ geo.group_count() * geo.inodes_per_group() }
+{
+}
+
+const ext2_inode& directory_walker::inode(u32 ino) const noexcept
+{
+    u32 const bg_num{ (ino - 1) / geo.inodes_per_group() };
+    u32 const index{ (ino - 1) % geo.inodes_per_group() };
+    return image.inode(geo.inode_offset(bg_num, index));
+}
+
+link_census directory_walker::walk(worker_pool& pool) const noexcept
+{
+    u32 const workers{ pool.size() };
+    std::vector<std::atomic<u32>> references(inodes + 1);
+    atomic_block_set entered{ inodes + 1 };
+    std::vector<work_queue> queues(workers);
+    // directories queued or being read; the walk is over when it drops to 0
+    std::atomic<u64> pending{ 1 };
+    // bumped whenever a queue gains a directory or pending drops, idle
+    // threads sleep on it instead of polling the queues
+    std::atomic<u64> changes{ 0 };
+    std::atomic<u64> directories{ 0 };
+    std::atomic<u64> entries{ 0 };
+
+    entered.set(EXT2_ROOT_INODE);
+    queues[0].directories.push_back(EXT2_ROOT_INODE);
+
+    auto const is_directory{ [&](u32 ino, u32 file_type)
+                             {
+                                 // the type in the entry is a hint, the
+                                 // inode has the final say
+                                 if (file_type != 0 &&
+                                     file_type != EXT2_D_DTYPE)
+                                 {
+                                     return false;
+                                 }
+                                 ext2_inode const& node{ inode(ino) };
+                                 return (node.mode & 0xf000U) ==
+                                          EXT2_I_DTYPE &&
+                                        node.deletion_time == 0;
+                             } };
+
+    auto const read_directory{
+        [&](work_queue& own, u32 dir)
+        {
+            u64 seen{ 0 };
+            for (block_view const& block :
+                 inode_block_range{ image, geo, inode(dir) })
+            {
+                for (dir_entry_view const& entry :
+                     dir_entry_range{ block.data })
+                {
+                    u32 const ino{ entry.entry->inode };
+                    if (ino > inodes)
+                    {
+                        continue;
+                    }
+                    ++seen;
+                    references[ino].fetch_add(1, std::memory_order_relaxed);
+                    if (entry.name == "." || entry.name == ".." ||
+                        !is_directory(ino, entry.entry->file_type) ||
+                        entered.set(ino))
+                    {
+                        continue;
+                    }
+                    pending.fetch_add(1);
+                    {
+                        std::scoped_lock guard{ own.lock };
+                        own.directories.push_back(ino);
+                    }
+                    changes.fetch_add(1);
+                    changes.notify_all();
+                }
+            }
+            entries.fetch_add(seen, std::memory_order_relaxed);
+            directories.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    pool.for_each(
+      workers,
+      [&](u32 self)
+      {
+          work_queue& own{ queues[self] };
+          for (;;)
+          {
+              // read before looking, so a push after the look wakes us
+              u64 const seen{ changes.load() };
+              u32 dir{ 0 };
+              bool found{ pop_front(own, dir) };
+              for (u32 k{ 1 }; !found && k < workers; ++k)
+              {
+                  found = steal_back(queues[(self + k) % workers], dir);
+              }
+              if (found)
+              {
+                  read_directory(own, dir);
+                  pending.fetch_sub(1);
+                  changes.fetch_add(1);
+                  changes.notify_all();
+                  continue;
+              }
+              if (pending.load() == 0)
+              {
+                  return;
+              }
+              changes.wait(seen);
+          }
+      });
+
+    link_census census;
+    census.references.resize(inodes + 1);
+    for (u32 ino{ 0 }; ino <= inodes; ++ino)
+    {
+        census.references[ino] = references[ino].load();
+    }
+    census.directories = directories.load();
+    census.entries = entries.load();
+    return census;
+}
@@ -0,0 +1,175 @@
+#include "ext2_ranges.hpp"
+
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+inode_range::inode_range(const mapped_image& image,
+                         const geometry& geo,
+                         u32 bg_num) noexcept
+  : table{ image.bytes(geo.inode_offset(bg_num, 0),
+                       static_cast<u64>(geo.inodes_per_group()) *
+                         geo.inode_size()) }
+  , record_size{ geo.inode_size() }
+  , first_number{ bg_num * geo.inodes_per_group() + 1 }
+  , count{ geo.inodes_per_group() }
+{
+}
+
+inode_range::iterator::iterator(const inode_range* range, u32 index) noexcept
+  : range{ range }
+  , index{ index }
+{
+}
+
+inode_view inode_range::iterator::operator*() const noexcept
+{
+    return { range->first_number + index,
+             range->table.subspan(static_cast<u64>(index) * range->record_size,
+                                  range->record_size) };
+}
+
+inode_block_range::inode_block_range(const mapped_image& image,
+                                     const geometry& geo,
+                                     const ext2_inode& inode,
+                                     bool with_indirect) noexcept
+  : image{ &image }
+  , block_count{ geo.block_count() }
+  , per_block{ geo.block_size() / sizeof(u32) }
+  , with_indirect{ with_indirect }
+{
+    // fast symlinks keep the target in the pointer array itself
+    if ((inode.mode & 0xf000U) == 0xA000U && inode.block_count_512 == 0)
+    {
+        return;
+    }
+    for (u32 i{ 0 }; i < EXT2_NUM_DIRECT_BLOCKS; ++i)
+    {
+        roots[i] = inode.direct_blocks[i];
+    }
+    roots[EXT2_NUM_DIRECT_BLOCKS] = inode.single_indirect;
+    roots[EXT2_NUM_DIRECT_BLOCKS + 1] = inode.double_indirect;
+    roots[EXT2_NUM_DIRECT_BLOCKS + 2] = inode.triple_indirect;
+}
+
+inode_block_range::iterator::iterator(const inode_block_range* range) noexcept
+  : range{ range }
+  , done{ false }
+{
+    advance();
+}
+
+void inode_block_range::iterator::advance() noexcept
+{
+    u64 const per_block{ range->per_block };
+    while (true)
+    {
+        u32 b{ 0 };
+        u32 depth{ 0 };
+        u64 logical{ 0 };
+        if (levels > 0)
+        {
+            frame& top{ stack[levels - 1] };
+            if (top.index == per_block)
+            {
+                --levels;
+                continue;
+            }
+            u32 const i{ top.index++ };
+            b = top.entries[i];
+            depth = top.child_depth;
+            logical = top.base + i * top.stride;
+        }
+        else if (slot < range->roots.size())
+        {
+            u32 const s{ slot++ };
+            b = range->roots[s];
+            depth = s < EXT2_NUM_DIRECT_BLOCKS
+                      ? 0
+                      : s - EXT2_NUM_DIRECT_BLOCKS + 1;
+            logical = std::min<u64>(s, EXT2_NUM_DIRECT_BLOCKS);
+            // each indirect tree starts where the previous one ends
+            u64 reach{ per_block };
+            for (u32 r{ EXT2_NUM_DIRECT_BLOCKS + 1 }; r <= s; ++r)
+            {
+                logical += reach;
+                reach *= per_block;
+            }
+        }
+        else
+        {
+            done = true;
+            return;
+        }
+
+        if (b == 0 || b >= range->block_count)
+        {
+            continue;
+        }
+        std::span<const u8> const data{ range->image->block(b) };
+        if (depth > 0)
+        {
+            u64 stride{ 1 };
+            for (u32 k{ 1 }; k < depth; ++k)
+            {
+                stride *= per_block;
+            }
+            stack[levels++] = { reinterpret_cast<const u32*>(data.data()),
+                                0,
+                                depth - 1,
+                                logical,
+                                stride };
+            if (!range->with_indirect)
+            {
+                continue;
+            }
+        }
+        current = { logical, b, depth, data };
+        return;
+    }
+}
+
+dir_entry_range::iterator::iterator(std::span<const u8> block) noexcept
+  : block{ block }
+  , done{ false }
+{
+    advance();
+}
+
+void dir_entry_range::iterator::advance() noexcept
+{
+    // a record is the 8 byte header followed by the name
+    constexpr u32 header{ 8 };
+    while (next + header <= block.size())
+    {
+        auto const* entry{ reinterpret_cast<const ext2_dir_entry*>(
+          block.data() + next) };
+        if (entry->length < header || next + entry->length > block.size() ||
+            entry->name_length > entry->length - header)
+        {
+            break;
+        }
+        u32 const offset{ next };
+        next += entry->length;
+        if (entry->inode != 0)
+        {
+            current = { offset,
+                        entry,
+                        { reinterpret_cast<const char*>(block.data() + offset +
+                                                        header),
+                          entry->name_length } };
+            return;
+        }
+    }
+    done = true;
+}
@@ -8,10 +8,20 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+/* Formats into a per-thread buffer with the reentrant calls, so workers can
+ * print concurrently. The result is valid until the thread's next call. */
 char* get_time_format(const uint32_t t)
 {
+    thread_local char buffer[32];
     const time_t t2 = (const long)t;
-    return strtok(asctime(localtime(&t2)), "\n");
+    struct tm parts;
+    if (localtime_r(&t2, &parts) == NULL || asctime_r(&parts, buffer) == NULL)
+    {
+        snprintf(buffer, sizeof(buffer), "%u", t);
+        return buffer;
+    }
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return buffer;
 }
 
 void print_stat(const struct stat* st)
@@ -0,0 +1,203 @@
+#include "fingerprint_index.hpp"
+
+#include "block_classifier.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <span>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+constexpr u64 fingerprint_magic{ 0x3250474632545845ULL }; // "EXT2FGP2"
+// records start on their own cache line after the header
+constexpr u64 records_offset{ 64 };
+
+struct header
+{
+    u64 magic;
+    fingerprint_index::identity image;
+    u32 record_size;
+    u32 reserved;
+};
+static_assert(sizeof(header) <= records_offset);
+
+// FNV-1a, only the data identifier is hashed
+u64 hash_bytes(std::span<const u8> data) noexcept
+{
+    u64 hash{ 0xcbf29ce484222325ULL };
+    for (u8 byte : data)
+    {
+        hash = (hash ^ byte) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string parent_directory(const std::string& path)
+{
+    auto const slash{ path.rfind('/') };
+    if (slash == std::string::npos)
+    {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+} // namespace
+
+fingerprint_index::fingerprint_index(std::string path, identity image) noexcept
+  : path{ std::move(path) }
+  , image{ image }
+  , mapping_size{ records_offset +
+                  static_cast<u64>(image.block_count) *
+                    sizeof(block_fingerprint) }
+{
+}
+
+fingerprint_index::~fingerprint_index() noexcept
+{
+    if (recording())
+    {
+        discard();
+    }
+    unmap();
+}
+
+fingerprint_index::identity fingerprint_index::describe(
+  int image_fd,
+  u64 block_size,
+  u32 block_count,
+  std::span<const u8> identifier) noexcept
+{
+    struct stat st
+    {};
+    fstat(image_fd, &st);
+    return { static_cast<u64>(st.st_size),
+             static_cast<u64>(st.st_mtim.tv_sec) * 1000000000ULL +
+               static_cast<u64>(st.st_mtim.tv_nsec),
+             hash_bytes(identifier),
+             static_cast<u32>(block_size),
+             block_count };
+}
+
+bool fingerprint_index::load() noexcept
+{
+    int const fd{ open(path.c_str(), O_RDONLY) };
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st
+    {};
+    header stored{};
+    bool const fits{ fstat(fd, &st) == 0 &&
+                     static_cast<u64>(st.st_size) == mapping_size &&
+                     pread(fd, &stored, sizeof(stored), 0) ==
+                       static_cast<ssize_t>(sizeof(stored)) &&
+                     stored.magic == fingerprint_magic &&
+                     stored.record_size == sizeof(block_fingerprint) &&
+                     std::memcmp(&stored.image, &image, sizeof(image)) == 0 };
+    if (fits)
+    {
+        mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (!fits || mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        return false;
+    }
+    records = reinterpret_cast<block_fingerprint*>(static_cast<u8*>(mapping) +
+                                                   records_offset);
+    loaded = true;
+    return true;
+}
+
+bool fingerprint_index::create() noexcept
+{
+    std::string const file{ temporary() };
+    int const fd{ open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) };
+    if (fd < 0)
+    {
+        std::cerr << "Could not create " << file << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    bool const sized{ ftruncate(fd, static_cast<off_t>(mapping_size)) == 0 };
+    if (sized)
+    {
+        mapping = mmap(
+          nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (!sized || mapping == MAP_FAILED)
+    {
+        std::cerr << "Could not map " << file << ": " << std::strerror(errno)
+                  << std::endl;
+        mapping = nullptr;
+        unlink(file.c_str());
+        return false;
+    }
+    records = reinterpret_cast<block_fingerprint*>(static_cast<u8*>(mapping) +
+                                                   records_offset);
+    return true;
+}
+
+bool fingerprint_index::commit() noexcept
+{
+    if (!recording())
+    {
+        return false;
+    }
+    // the header goes in last, a file without one is never trusted
+    header const stored{
+        fingerprint_magic, image, sizeof(block_fingerprint), 0
+    };
+    std::memcpy(mapping, &stored, sizeof(stored));
+    std::string const file{ temporary() };
+    bool const ok{ msync(mapping, mapping_size, MS_SYNC) == 0 &&
+                   std::rename(file.c_str(), path.c_str()) == 0 };
+    if (!ok)
+    {
+        std::cerr << "Could not save fingerprints " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        discard();
+        return false;
+    }
+    int const dir{ open(parent_directory(path).c_str(), O_RDONLY) };
+    if (dir >= 0)
+    {
+        fsync(dir);
+        close(dir);
+    }
+    loaded = true;
+    return true;
+}
+
+void fingerprint_index::discard() noexcept
+{
+    unmap();
+    unlink(temporary().c_str());
+}
+
+void fingerprint_index::unmap() noexcept
+{
+    if (mapping != nullptr)
+    {
+        munmap(mapping, mapping_size);
+    }
+    mapping = nullptr;
+    records = nullptr;
+    loaded = false;
+}
@@ -0,0 +1,174 @@
+#include "geometry.hpp"
+
+#include "ext2fs.hpp"
+#include "mapped_image.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+// ext2 block sizes run from 1 KiB to 64 KiB
+constexpr u32 max_log_block_size{ 6 };
+// s_first_meta_bg, past the fields ext2_super_block declares
+constexpr u64 first_meta_bg_offset{ 0x104 };
+
+[[noreturn]] void reject(const std::string& reason)
+{
+    std::cerr << "Invalid super block: " << reason << std::endl;
+    throw std::runtime_error(reason);
+}
+} // namespace
+
+geometry::geometry(const mapped_image& image)
+{
+    ext2_super_block const& sb{ image.super_block() };
+    if (sb.magic != EXT2_SUPER_MAGIC)
+    {
+        reject("bad magic " + std::to_string(sb.magic));
+    }
+    if (sb.log_block_size > max_log_block_size)
+    {
+        reject("block size log " + std::to_string(sb.log_block_size) +
+               " out of range");
+    }
+    block_shift = 10 + sb.log_block_size;
+    blocks = sb.block_count;
+    first_data = sb.first_data_block;
+    group_blocks = sb.blocks_per_group;
+    group_inodes = sb.inodes_per_group;
+    // revision 0 file systems have fixed 128 byte inodes and no first_inode
+    inode_bytes = sb.rev_level == 0 ? 128U : sb.inode_size;
+    first_ino = sb.rev_level == 0 ? 11U : sb.first_inode;
+
+    // a group is as large as one bitmap block can describe
+    u64 const bitmap_bits{ block_size() * 8 };
+    if (group_blocks == 0 || group_blocks > bitmap_bits)
+    {
+        reject("blocks per group " + std::to_string(group_blocks) +
+               " out of range");
+    }
+    if (group_inodes == 0 || group_inodes > bitmap_bits)
+    {
+        reject("inodes per group " + std::to_string(group_inodes) +
+               " out of range");
+    }
+    if (inode_bytes < 128 || inode_bytes > block_size() ||
+        (inode_bytes & (inode_bytes - 1)) != 0)
+    {
+        reject("inode size " + std::to_string(inode_bytes) + " out of range");
+    }
+    if (first_data >= blocks || blocks > image.size() >> block_shift)
+    {
+        reject("block count " + std::to_string(blocks) +
+               " does not fit the image");
+    }
+    table_blocks = static_cast<u32>(
+      (static_cast<u64>(group_inodes) * inode_bytes + block_size() - 1) >>
+      block_shift);
+    // the primary table sits in the block right after the super block
+    descriptor_table = block_offset(first_data + 1);
+
+    bool const sparse{ (sb.feature_ro_compat &
+                        EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER) != 0 };
+    u32 const groups{ (blocks - first_data + group_blocks - 1) /
+                      group_blocks };
+    // meta_bg gives every run of groups one descriptor block in its first
+    // group. The first run's block is where the flat table starts, so only
+    // images that need a second run are out of reach.
+    bool const meta_bg{ (sb.feature_incompat &
+                         EXT2_FEATURE_INCOMPAT_META_BG) != 0 };
+    if (meta_bg)
+    {
+        u64 const per_block{ block_size() /
+                             sizeof(ext2_block_group_descriptor) };
+        u32 const first_meta_bg{ image.view<u32>(EXT2_SUPER_BLOCK_POSITION +
+                                                 first_meta_bg_offset) };
+        if (groups > std::max<u64>(first_meta_bg, 1) * per_block)
+        {
+            reject("meta_bg layout with " + std::to_string(groups) +
+                   " groups is not supported");
+        }
+    }
+    if (descriptor_offset(groups) > image.size())
+    {
+        reject("descriptor table past the end of the image");
+    }
+    layouts.reserve(groups);
+    for (u32 g{ 0 }; g < groups; ++g)
+    {
+        ext2_block_group_descriptor const& bg{ image.group_desc(
+          descriptor_offset(g)) };
+        group_layout layout{};
+        layout.first_block = first_data + g * group_blocks;
+        layout.block_count =
+          std::min(group_blocks, blocks - layout.first_block);
+        // bitmaps and inode table sit in their own group, which the block
+        // count check above keeps inside the mapping
+        u64 const group_end{ static_cast<u64>(layout.first_block) +
+                             layout.block_count };
+        auto const inside{ [&](u64 b_num, u64 count)
+                           {
+                               return b_num != 0 &&
+                                      b_num >= layout.first_block &&
+                                      b_num + count <= group_end;
+                           } };
+        if (!inside(bg.block_bitmap, 1) || !inside(bg.inode_bitmap, 1) ||
+            !inside(bg.inode_table, table_blocks))
+        {
+            reject("descriptor of group " + std::to_string(g) +
+                   " points outside the group");
+        }
+        layout.has_super_block = has_super_block(g, sparse);
+        layout.super_block = g == 0 ? EXT2_SUPER_BLOCK_POSITION
+                                    : block_offset(layout.first_block);
+        // under meta_bg only the first two groups of the run keep a copy
+        layout.descriptor_table =
+          layout.has_super_block && (!meta_bg || g <= 1)
+            ? layout.first_block + 1
+            : 0;
+        layout.block_bitmap = bg.block_bitmap;
+        layout.inode_bitmap = bg.inode_bitmap;
+        layout.inode_table = bg.inode_table;
+        layout.metadata_end = bg.inode_table + table_blocks;
+        layouts.emplace_back(layout);
+    }
+}
+
+bool geometry::is_metadata(u32 b_num) const noexcept
+{
+    if (b_num < first_data)
+    {
+        return true;
+    }
+    u32 const bg_num{ (b_num - first_data) / group_blocks };
+    return bg_num < layouts.size() && b_num < layouts[bg_num].metadata_end;
+}
+
+bool geometry::has_super_block(u32 bg_num, bool sparse) noexcept
+{
+    if (!sparse || bg_num <= 1)
+    {
+        return true;
+    }
+    // sparse_super keeps copies in groups that are powers of 3, 5 and 7
+    for (u32 base : { 3U, 5U, 7U })
+    {
+        u32 n{ bg_num };
+        while (n % base == 0)
+        {
+            n /= base;
+        }
+        if (n == 1)
+        {
+            return true;
+        }
+    }
+    return false;
+}
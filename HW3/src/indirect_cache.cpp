@@ -0,0 +1,112 @@
+#include "indirect_cache.hpp"
+
+#include "mapped_image.hpp"
+#include "recovery_stats.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+// list node, index slot and shared_ptr control block of one entry, roughly
+constexpr u64 entry_overhead{ 128 };
+} // namespace
+
+indirect_cache::indirect_cache(const mapped_image& image,
+                               u64 block_size,
+                               u32 block_count,
+                               u64 budget,
+                               cache_counters* counters) noexcept
+  : image{ image }
+  , block_size{ block_size }
+  , block_count{ block_count }
+  , shard_budget{ budget / shard_count }
+  , counters{ counters }
+{
+}
+
+std::shared_ptr<const indirect_cache::pointer_list> indirect_cache::pointers(
+  u32 b_num) const noexcept
+{
+    shard& s{ shard_of(b_num) };
+    {
+        std::scoped_lock guard{ s.lock };
+        auto const it{ s.index.find(b_num) };
+        if (it != s.index.end())
+        {
+            s.recent.splice(s.recent.begin(), s.recent, it->second);
+            if (counters != nullptr)
+            {
+                counters->add_hit();
+            }
+            return it->second->pointers;
+        }
+    }
+    if (counters != nullptr)
+    {
+        counters->add_miss();
+    }
+
+    // decode without the lock, a racing miss on the same block decodes it
+    // twice and keeps the first copy
+    auto decoded{ std::make_shared<const pointer_list>(decode(b_num)) };
+    u64 const bytes{ decoded->capacity() * sizeof(u32) + entry_overhead };
+    if (bytes > shard_budget)
+    {
+        return decoded;
+    }
+
+    std::scoped_lock guard{ s.lock };
+    auto const [it, inserted]{ s.index.try_emplace(b_num) };
+    if (!inserted)
+    {
+        return it->second->pointers;
+    }
+    s.recent.push_front({ b_num, decoded, bytes });
+    it->second = s.recent.begin();
+    s.bytes += bytes;
+    while (s.bytes > shard_budget)
+    {
+        entry const& oldest{ s.recent.back() };
+        s.bytes -= oldest.bytes;
+        s.index.erase(oldest.b_num);
+        s.recent.pop_back();
+        if (counters != nullptr)
+        {
+            counters->add_eviction();
+        }
+    }
+    return decoded;
+}
+
+indirect_cache::shard& indirect_cache::shard_of(u32 b_num) const noexcept
+{
+    // the blocks of one file are mostly consecutive, spread them out
+    return shards[(b_num * 0x9e3779b1U) >> (32 - shard_bits)];
+}
+
+indirect_cache::pointer_list indirect_cache::decode(u32 b_num) const noexcept
+{
+    std::span<const u8> const block{ image.block(b_num) };
+    u64 const count{ block_size / sizeof(u32) };
+    pointer_list valid;
+    for (u64 i{ 0 }; i < count; ++i)
+    {
+        u32 b;
+        std::memcpy(&b, block.data() + i * sizeof(u32), sizeof(u32));
+        if (b != 0 && b < block_count)
+        {
+            valid.emplace_back(b);
+        }
+    }
+    valid.shrink_to_fit();
+    return valid;
+}
@@ -1,8 +1,27 @@
+#include "batch.hpp"
+#include "options.hpp"
 #include "recext2fs.hpp"
+#include "worker_pool.hpp"
+
+#include <exception>
+#include <utility>
 
 int main(int argc, char* argv[])
 {
-    recext2fs fs{ argc, argv };
-    fs.recover_bitmap();
-    return 0;
+    options opts{ options::parse(argc, argv) };
+    worker_pool pool{ opts.threads };
+    if (!opts.batch_path.empty())
+    {
+        return recover_batch(opts, pool) ? 0 : 1;
+    }
+    try
+    {
+        recext2fs fs{ std::move(opts), pool };
+        return fs.recover_bitmap() ? 0 : 1;
+    }
+    catch (const std::exception&)
+    {
+        // the image or its geometry has already said what went wrong
+        return 1;
+    }
 }
@@ -0,0 +1,71 @@
+#include "mapped_image.hpp"
+
+#include "ext2fs.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using u64 = std::uint64_t;
+
+mapped_image::mapped_image(const std::string& location, image_access access)
+  : access{ access }
+{
+    fd = open(location.c_str(), writable() ? O_RDWR : O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Could not open the image: " << location << ": "
+                  << std::strerror(errno) << std::endl;
+        throw std::invalid_argument(location);
+    }
+
+    struct stat st
+    {};
+    if (fstat(fd, &st) < 0 ||
+        static_cast<u64>(st.st_size) <
+          EXT2_SUPER_BLOCK_POSITION + sizeof(ext2_super_block))
+    {
+        std::cerr << "Image is too small to hold a super block: " << location
+                  << std::endl;
+        close(fd);
+        throw std::invalid_argument(location);
+    }
+    length = static_cast<u64>(st.st_size);
+
+    int const protection{ writable() ? PROT_READ | PROT_WRITE : PROT_READ };
+    void* addr{ mmap(nullptr, length, protection, MAP_SHARED, fd, 0) };
+    if (addr == MAP_FAILED)
+    {
+        std::cerr << "Could not map the image: " << location << ": "
+                  << std::strerror(errno) << std::endl;
+        close(fd);
+        throw std::runtime_error(location);
+    }
+    base = static_cast<u8*>(addr);
+
+    block_size = EXT2_UNLOG(super_block().log_block_size);
+}
+
+mapped_image::~mapped_image() noexcept
+{
+    if (writable())
+    {
+        sync();
+    }
+    munmap(base, length);
+    close(fd);
+}
+
+void mapped_image::sync() const noexcept
+{
+    if (msync(base, length, MS_SYNC) < 0)
+    {
+        std::cerr << "msync failed: " << std::strerror(errno) << std::endl;
+    }
+}
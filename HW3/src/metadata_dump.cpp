@@ -0,0 +1,285 @@
+#include "metadata_dump.hpp"
+
+#include "ext2_ranges.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+namespace
+{
+// groups formatted before their text is written out, bounds the memory
+constexpr u32 groups_per_batch{ 64 };
+constexpr u64 initial_buffer{ 1UL << 20 };
+
+constexpr std::string_view super_block_columns{
+    "#super_block,inode_count,block_count,reserved_block_count,"
+    "free_block_count,free_inode_count,first_data_block,log_block_size,"
+    "blocks_per_group,inodes_per_group,mount_time,write_time,mount_count,"
+    "magic,state,rev_level,first_inode,inode_size,feature_compat,"
+    "feature_incompat,feature_ro_compat\n"
+};
+constexpr std::string_view group_columns{
+    "#group,group,block_bitmap,inode_bitmap,inode_table,free_block_count,"
+    "free_inode_count,used_dirs_count\n"
+};
+constexpr std::string_view inode_columns{
+    "#inode,inode,mode,uid,gid,size,access_time,creation_time,"
+    "modification_time,deletion_time,link_count,block_count_512,flags,"
+    "single_indirect,double_indirect,triple_indirect\n"
+};
+constexpr std::string_view dir_entry_columns{
+    "#dir_entry,directory,block,offset,inode,file_type,name\n"
+};
+
+void write_text(std::ostream& out, std::string_view text)
+{
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+} // namespace
+
+record_writer::record_writer(dump_format format) noexcept
+  : format{ format }
+{
+    buffer.reserve(initial_buffer);
+}
+
+void record_writer::header()
+{
+    if (format == dump_format::csv)
+    {
+        append(super_block_columns);
+        append(group_columns);
+        append(inode_columns);
+        append(dir_entry_columns);
+    }
+}
+
+void record_writer::super_block(const ext2_super_block& sb)
+{
+    begin("super_block");
+    field("inode_count", sb.inode_count);
+    field("block_count", sb.block_count);
+    field("reserved_block_count", sb.reserved_block_count);
+    field("free_block_count", sb.free_block_count);
+    field("free_inode_count", sb.free_inode_count);
+    field("first_data_block", sb.first_data_block);
+    field("log_block_size", sb.log_block_size);
+    field("blocks_per_group", sb.blocks_per_group);
+    field("inodes_per_group", sb.inodes_per_group);
+    field("mount_time", sb.mount_time);
+    field("write_time", sb.write_time);
+    field("mount_count", sb.mount_count);
+    field("magic", sb.magic);
+    field("state", sb.state);
+    field("rev_level", sb.rev_level);
+    field("first_inode", sb.first_inode);
+    field("inode_size", sb.inode_size);
+    field("feature_compat", sb.feature_compat);
+    field("feature_incompat", sb.feature_incompat);
+    field("feature_ro_compat", sb.feature_ro_compat);
+    end();
+}
+
+void record_writer::group(u32 bg_num, const ext2_block_group_descriptor& bg)
+{
+    begin("group");
+    field("group", bg_num);
+    field("block_bitmap", bg.block_bitmap);
+    field("inode_bitmap", bg.inode_bitmap);
+    field("inode_table", bg.inode_table);
+    field("free_block_count", bg.free_block_count);
+    field("free_inode_count", bg.free_inode_count);
+    field("used_dirs_count", bg.used_dirs_count);
+    end();
+}
+
+void record_writer::inode(u32 number, const ext2_inode& inode)
+{
+    begin("inode");
+    field("inode", number);
+    field("mode", inode.mode);
+    field("uid", inode.uid);
+    field("gid", inode.gid);
+    field("size", inode.size);
+    field("access_time", inode.access_time);
+    field("creation_time", inode.creation_time);
+    field("modification_time", inode.modification_time);
+    field("deletion_time", inode.deletion_time);
+    field("link_count", inode.link_count);
+    field("block_count_512", inode.block_count_512);
+    field("flags", inode.flags);
+    field("single_indirect", inode.single_indirect);
+    field("double_indirect", inode.double_indirect);
+    field("triple_indirect", inode.triple_indirect);
+    end();
+}
+
+void record_writer::dir_entry(u32 directory,
+                              u32 block,
+                              const dir_entry_view& entry)
+{
+    begin("dir_entry");
+    field("directory", directory);
+    field("block", block);
+    field("offset", entry.offset);
+    field("inode", entry.entry->inode);
+    field("file_type", entry.entry->file_type);
+    field("name", entry.name);
+    end();
+}
+
+void record_writer::begin(std::string_view kind)
+{
+    if (format == dump_format::jsonl)
+    {
+        append("{\"record\":\"");
+        append(kind);
+        append("\"");
+    }
+    else
+    {
+        append(kind);
+    }
+}
+
+void record_writer::end()
+{
+    append(format == dump_format::jsonl ? "}\n" : "\n");
+}
+
+void record_writer::field(std::string_view name, u64 value)
+{
+    if (format == dump_format::jsonl)
+    {
+        append(",\"");
+        append(name);
+        append("\":");
+    }
+    else
+    {
+        append(",");
+    }
+    char digits[20];
+    auto const [last, error]{ std::to_chars(
+      digits, digits + sizeof(digits), value) };
+    append({ digits, static_cast<std::size_t>(last - digits) });
+}
+
+void record_writer::field(std::string_view name, std::string_view value)
+{
+    if (format == dump_format::jsonl)
+    {
+        append(",\"");
+        append(name);
+        append("\":\"");
+        for (char c : value)
+        {
+            auto const byte{ static_cast<unsigned char>(c) };
+            if (c == '"' || c == '\\')
+            {
+                buffer.push_back('\\');
+                buffer.push_back(c);
+            }
+            else if (byte < 0x20 || byte >= 0x7f)
+            {
+                // names are raw bytes, keep the output valid ASCII JSON
+                char const* hex{ "0123456789abcdef" };
+                append("\\u00");
+                buffer.push_back(hex[byte >> 4]);
+                buffer.push_back(hex[byte & 0xf]);
+            }
+            else
+            {
+                buffer.push_back(c);
+            }
+        }
+        append("\"");
+        return;
+    }
+    // CSV quotes every name and doubles embedded quotes
+    append(",\"");
+    for (char c : value)
+    {
+        if (c == '"')
+        {
+            buffer.push_back('"');
+        }
+        buffer.push_back(c);
+    }
+    append("\"");
+}
+
+void record_writer::append(std::string_view text)
+{
+    buffer.insert(buffer.end(), text.begin(), text.end());
+}
+
+void dump_metadata(const mapped_image& image,
+                   const geometry& geo,
+                   worker_pool& pool,
+                   dump_format format,
+                   std::ostream& out)
+{
+    record_writer head{ format };
+    head.header();
+    head.super_block(image.super_block());
+    for (u32 bg_num{ 0 }; bg_num < geo.group_count(); ++bg_num)
+    {
+        head.group(bg_num, image.group_desc(geo.descriptor_offset(bg_num)));
+    }
+    write_text(out, head.text());
+
+    std::vector<record_writer> writers(groups_per_batch,
+                                       record_writer{ format });
+    for (u32 first{ 0 }; first < geo.group_count(); first += groups_per_batch)
+    {
+        u32 const count{ std::min(groups_per_batch,
+                                  geo.group_count() - first) };
+        pool.for_each(
+          count,
+          [&](u32 i)
+          {
+              record_writer& writer{ writers[i] };
+              writer.clear();
+              for (inode_view const& node :
+                   inode_range{ image, geo, first + i })
+              {
+                  u32 const mode{ node.inode().mode };
+                  if (mode == 0)
+                  {
+                      continue;
+                  }
+                  writer.inode(node.number, node.inode());
+                  if (!node.live() || (mode & 0xf000U) != EXT2_I_DTYPE)
+                  {
+                      continue;
+                  }
+                  for (block_view const& block :
+                       inode_block_range{ image, geo, node.inode() })
+                  {
+                      for (dir_entry_view const& entry :
+                           dir_entry_range{ block.data })
+                      {
+                          writer.dir_entry(node.number, block.number, entry);
+                      }
+                  }
+              }
+          });
+        for (u32 i{ 0 }; i < count; ++i)
+        {
+            write_text(out, writers[i].text());
+        }
+    }
+    out.flush();
+}
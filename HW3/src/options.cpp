@@ -0,0 +1,179 @@
+#include "options.hpp"
+
+#include "metadata_dump.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+void print_usage(const char* program)
+{
+    std::cerr << "Usage: " << program
+              << " [--threads=N] [--mode=content|pointers] [--list-orphans]"
+              << " [--repair-pointers] [--dry-run] [--resume] [--verify]"
+              << " [--stats[=FILE]] [--dump=jsonl|csv] [--indirect-cache=MIB]"
+              << " [--undelete=DIR] [--fingerprints[=FILE]]"
+              << " [--links=check|fix]"
+              << " <image_location> <data_identifier>" << std::endl;
+    std::cerr << "       " << program << " [flags] --batch=MANIFEST"
+              << std::endl;
+}
+
+unsigned parse_count(std::string_view flag, std::string_view value)
+{
+    unsigned count{ 0 };
+    if (std::sscanf(std::string{ value }.c_str(), "%u", &count) != 1 ||
+        count == 0)
+    {
+        std::cerr << "Invalid value for " << flag << ": " << value
+                  << std::endl;
+        throw std::invalid_argument(std::string{ flag });
+    }
+    return count;
+}
+} // namespace
+
+options options::parse(int argc, char* argv[])
+{
+    options opts{};
+    std::vector<std::string_view> positional;
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        std::string_view const arg{ argv[i] };
+        if (!arg.starts_with("--"))
+        {
+            positional.emplace_back(arg);
+            continue;
+        }
+        std::string_view const flag{ arg.substr(0, arg.find('=')) };
+        std::string_view const value{
+            arg.find('=') == std::string_view::npos
+              ? std::string_view{}
+              : arg.substr(arg.find('=') + 1)
+        };
+        if (flag == "--threads")
+        {
+            opts.threads = parse_count(flag, value);
+        }
+        else if (flag == "--indirect-cache")
+        {
+            opts.indirect_cache_mib = parse_count(flag, value);
+        }
+        else if (arg == "--list-orphans")
+        {
+            opts.list_orphans = true;
+        }
+        else if (arg == "--repair-pointers")
+        {
+            opts.repair_pointers = true;
+        }
+        else if (arg == "--stats")
+        {
+            opts.stats_path = "-";
+        }
+        else if (flag == "--stats" && !value.empty())
+        {
+            opts.stats_path = std::string{ value };
+        }
+        else if (arg == "--verify")
+        {
+            opts.verify = true;
+        }
+        else if (flag == "--links" && value == "check")
+        {
+            opts.links = link_check::report;
+        }
+        else if (flag == "--links" && value == "fix")
+        {
+            opts.links = link_check::fix;
+        }
+        else if (flag == "--fingerprints")
+        {
+            opts.fingerprints = std::string{ value };
+        }
+        else if (flag == "--undelete" && !value.empty())
+        {
+            opts.undelete_dir = std::string{ value };
+        }
+        else if (flag == "--batch" && !value.empty())
+        {
+            opts.batch_path = std::string{ value };
+        }
+        else if (flag == "--dump" && value == "jsonl")
+        {
+            opts.dump = dump_format::jsonl;
+        }
+        else if (flag == "--dump" && value == "csv")
+        {
+            opts.dump = dump_format::csv;
+        }
+        else if (arg == "--resume")
+        {
+            opts.resume = true;
+        }
+        else if (arg == "--dry-run")
+        {
+            opts.dry_run = true;
+        }
+        else if (flag == "--mode" && value == "content")
+        {
+            opts.mode = rebuild_mode::content;
+        }
+        else if (flag == "--mode" && value == "pointers")
+        {
+            opts.mode = rebuild_mode::pointers;
+        }
+        else
+        {
+            std::cerr << "Unknown flag: " << arg << std::endl;
+            print_usage(argv[0]);
+            throw std::invalid_argument(std::string{ arg });
+        }
+    }
+
+    if (!opts.batch_path.empty())
+    {
+        // images and identifiers come from the manifest
+        if (!positional.empty() || opts.dump || !opts.undelete_dir.empty())
+        {
+            print_usage(argv[0]);
+            throw std::invalid_argument("Invalid arguments for --batch");
+        }
+        return opts;
+    }
+    if (positional.size() < 2)
+    {
+        print_usage(argv[0]);
+        throw std::invalid_argument("Invalid number of arguments");
+    }
+    opts.image_location = std::string{ positional[0] };
+    opts.data_identifier =
+      parse_identifier(std::span{ positional }.subspan(1));
+    return opts;
+}
+
+std::vector<std::uint8_t> options::parse_identifier(
+  std::span<const std::string_view> bytes)
+{
+    std::vector<std::uint8_t> identifier;
+    for (std::string_view byte : bytes)
+    {
+        unsigned temp{ 0 };
+        std::sscanf(std::string{ byte }.c_str(), "%x", &temp);
+        identifier.emplace_back(temp);
+    }
+    return identifier;
+}
+
+unsigned options::default_threads() noexcept
+{
+    return std::max(std::thread::hardware_concurrency(), 1U);
+}
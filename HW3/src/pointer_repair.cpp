@@ -0,0 +1,325 @@
+#include "pointer_repair.hpp"
+
+#include "block_set.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "orphan_index.hpp"
+#include "write_back.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+pointer_repair::pointer_repair(write_back& staged,
+                               const geometry& geo,
+                               orphan_blocks& orphans,
+                               block_set& used) noexcept
+  : staged{ staged }
+  , geo{ geo }
+  , block_count{ geo.block_count() }
+  , block_size{ geo.block_size() }
+  , per_block{ block_size / sizeof(u32) }
+  , orphans{ orphans }
+  , used{ used }
+  , is_dot_block{ block_count }
+{
+    for (u32 b : orphans.untagged.blocks())
+    {
+        if (looks_like_pointers(b))
+        {
+            pointer_depth.emplace(b, 0);
+        }
+    }
+    for (auto& [b, depth] : pointer_depth)
+    {
+        depth = depth_of(b);
+    }
+
+    // an orphan indirect block reachable from another one travels with it
+    block_set nested{ block_count };
+    for (auto const& [b, depth] : pointer_depth)
+    {
+        u32 const* entries{ pointers(b) };
+        for (u64 i{ 0 }; i < per_block && entries[i] != 0; ++i)
+        {
+            if (pointer_depth.contains(entries[i]))
+            {
+                nested.set(entries[i]);
+            }
+        }
+    }
+
+    std::array<std::vector<u32>, 3> candidates;
+    for (auto const& [b, depth] : pointer_depth)
+    {
+        orphans.untagged.claim(b);
+        if (!nested.test(b))
+        {
+            candidates[depth - 1].emplace_back(b);
+            reserve_children(b);
+        }
+    }
+    for (u32 i{ 0 }; i < candidates.size(); ++i)
+    {
+        top_level[i].emplace(block_count, std::move(candidates[i]));
+    }
+
+    for (u32 b : orphans.untagged.blocks())
+    {
+        if (!orphans.untagged.contains(b))
+        {
+            continue;
+        }
+        auto const& entry{ *reinterpret_cast<const ext2_dir_entry*>(
+          staged.view(b).data()) };
+        if (entry.inode != 0 && entry.name_length == 1 &&
+            entry.name[0] == '.')
+        {
+            dot_blocks.emplace(entry.inode, b);
+            is_dot_block.set(b);
+        }
+    }
+}
+
+u32 pointer_repair::repair(const damaged_inode& damaged,
+                           u64 inode_offset) noexcept
+{
+    // the resize inode and friends have regular modes but are not files
+    if (damaged.number < geo.first_inode() &&
+        damaged.number != EXT2_ROOT_INODE)
+    {
+        return 0;
+    }
+    ext2_inode const inode{ staged.read<ext2_inode>(inode_offset) };
+    u32 const type{ inode.mode & 0xf000U };
+    if (type != EXT2_I_FTYPE && type != EXT2_I_DTYPE)
+    {
+        return 0;
+    }
+    bool const directory{ type == EXT2_I_DTYPE };
+    u64 const data_blocks{ (inode.size + block_size - 1) / block_size };
+
+    fill state{ damaged.missing, 0, 0, 0 };
+    for (u64 logical{ 0 };
+         logical < data_blocks && state.reached < state.missing;
+         ++logical)
+    {
+        u64 const slot{ locate_slot(inode_offset, logical, state) };
+        if (slot == 0)
+        {
+            break;
+        }
+        u32 b{ staged.read<u32>(slot) };
+        // a data pointer past the end was never reached by the walk either
+        if (b == 0 || b >= block_count)
+        {
+            // an indirect block may have used up what was missing
+            if (state.reached >= state.missing)
+            {
+                break;
+            }
+            b = claim_data_block(
+              damaged.number, directory, logical, state.near);
+            if (b == 0)
+            {
+                break;
+            }
+            staged.write(slot, b);
+            used.set(b);
+            ++state.reached;
+            ++state.restored;
+        }
+        state.near = b;
+    }
+    return state.restored;
+}
+
+const u32* pointer_repair::pointers(u32 b_num) const noexcept
+{
+    return reinterpret_cast<const u32*>(staged.view(b_num).data());
+}
+
+bool pointer_repair::looks_like_pointers(u32 b_num) const noexcept
+{
+    // a run of valid block numbers followed by nothing but zeros
+    u32 const* entries{ pointers(b_num) };
+    u64 i{ 0 };
+    for (; i < per_block && entries[i] != 0; ++i)
+    {
+        if (entries[i] >= block_count)
+        {
+            return false;
+        }
+    }
+    if (i == 0)
+    {
+        return false;
+    }
+    for (; i < per_block; ++i)
+    {
+        if (entries[i] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+u32 pointer_repair::depth_of(u32 b_num) const noexcept
+{
+    u32 depth{ 1 };
+    u32 child{ pointers(b_num)[0] };
+    while (depth < 3 && pointer_depth.contains(child))
+    {
+        ++depth;
+        child = pointers(child)[0];
+    }
+    return depth;
+}
+
+void pointer_repair::reserve_children(u32 b_num) noexcept
+{
+    u32 const* entries{ pointers(b_num) };
+    bool const leaf{ pointer_depth.at(b_num) == 1 };
+    for (u64 i{ 0 }; i < per_block && entries[i] != 0; ++i)
+    {
+        orphans.data.claim(entries[i]);
+        orphans.untagged.claim(entries[i]);
+        if (!leaf && pointer_depth.contains(entries[i]))
+        {
+            reserve_children(entries[i]);
+        }
+    }
+}
+
+void pointer_repair::adopt(u32 b_num, fill& state) noexcept
+{
+    used.set(b_num);
+    ++state.reached;
+    ++state.restored;
+    u32 const* entries{ pointers(b_num) };
+    bool const leaf{ pointer_depth.at(b_num) == 1 };
+    for (u64 i{ 0 }; i < per_block && entries[i] != 0; ++i)
+    {
+        if (!leaf && pointer_depth.contains(entries[i]))
+        {
+            adopt(entries[i], state);
+        }
+        else
+        {
+            used.set(entries[i]);
+            ++state.reached;
+        }
+    }
+}
+
+bool pointer_repair::followable(u32 b_num) const noexcept
+{
+    return b_num != 0 && b_num < block_count && !geo.is_metadata(b_num);
+}
+
+u64 pointer_repair::locate_slot(u64 inode_offset,
+                                u64 logical,
+                                fill& state) noexcept
+{
+    if (logical < EXT2_NUM_DIRECT_BLOCKS)
+    {
+        return inode_offset + offsetof(ext2_inode, direct_blocks) +
+               logical * sizeof(u32);
+    }
+    logical -= EXT2_NUM_DIRECT_BLOCKS;
+
+    std::array<u64, 3> const roots{ offsetof(ext2_inode, single_indirect),
+                                    offsetof(ext2_inode, double_indirect),
+                                    offsetof(ext2_inode, triple_indirect) };
+    u32 depth{ 1 };
+    u64 reach{ per_block };
+    while (logical >= reach)
+    {
+        logical -= reach;
+        if (++depth > roots.size())
+        {
+            return 0;
+        }
+        reach *= per_block;
+    }
+
+    u64 slot{ inode_offset + roots[depth - 1] };
+    for (; depth > 0; --depth)
+    {
+        u32 b{ staged.read<u32>(slot) };
+        // a corrupt pointer is replaced like a lost one, never followed
+        if (!followable(b))
+        {
+            if (state.reached >= state.missing)
+            {
+                return 0;
+            }
+            b = claim_pointer_block(depth, state);
+            if (b == 0)
+            {
+                return 0;
+            }
+            staged.write(slot, b);
+        }
+        state.near = b;
+        reach /= per_block;
+        slot = static_cast<u64>(b) * block_size +
+               (logical / reach) * sizeof(u32);
+        logical %= reach;
+    }
+    return slot;
+}
+
+u32 pointer_repair::claim_pointer_block(u32 depth, fill& state) noexcept
+{
+    orphan_index& pool{ *top_level[depth - 1] };
+    u32 b{ pool.next(state.near + 1) };
+    if (b == 0)
+    {
+        b = pool.next();
+    }
+    if (b != 0)
+    {
+        pool.claim(b);
+        adopt(b, state);
+    }
+    return b;
+}
+
+u32 pointer_repair::claim_data_block(u32 ino,
+                                     bool directory,
+                                     u64 logical,
+                                     u32 near) noexcept
+{
+    if (directory && logical == 0)
+    {
+        auto const it{ dot_blocks.find(ino) };
+        if (it != dot_blocks.end() && orphans.untagged.contains(it->second))
+        {
+            orphans.untagged.claim(it->second);
+            return it->second;
+        }
+    }
+
+    orphan_index& pool{ directory ? orphans.untagged : orphans.data };
+    // prefer the block right after the previous one, then wrap around
+    for (u32 from : { near + 1, 0U })
+    {
+        for (u32 b{ pool.next(from) }; b != 0; b = pool.next(b + 1))
+        {
+            if (!is_dot_block.test(b))
+            {
+                pool.claim(b);
+                return b;
+            }
+        }
+    }
+    return 0;
+}
@@ -1,147 +1,1188 @@
 #include "recext2fs.hpp"
 
+#include "bit_count.hpp"
+#include "bit_diff.hpp"
+#include "block_classifier.hpp"
+#include "block_scanner.hpp"
+#include "block_size.hpp"
+#include "checkpoint.hpp"
+#include "directory_walker.hpp"
+#include "ext2_ranges.hpp"
 #include "ext2fs.hpp"
 #include "ext2fs_print.hpp"
+#include "fingerprint_index.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+#include "metadata_dump.hpp"
+#include "options.hpp"
+#include "orphan_index.hpp"
+#include "pointer_repair.hpp"
+#include "recovery_stats.hpp"
+#include "undelete.hpp"
+#include "worker_pool.hpp"
 
+#include <algorithm>
+#include <array>
 #include <assert.h>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
-#include <ios>
 #include <iostream>
-#include <stdexcept>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <span>
 #include <string>
+#include <sys/stat.h>
 #include <utility>
 #include <vector>
 
 using u8 = std::uint8_t;
 using u32 = std::uint32_t;
 using u64 = std::uint64_t;
-using i64 = std::int64_t;
-using pos = std::fstream::pos_type;
 
-recext2fs::recext2fs(int argc, char* argv[])
+namespace
 {
-    if (argc < 3)
+// block groups rebuilt between two checkpoints
+constexpr u64 checkpoint_groups{ 64 };
+} // namespace
+
+recext2fs::recext2fs(options settings, worker_pool& pool, std::ostream& out)
+  : stats{}
+  , opts{ std::move(settings) }
+  , pool{ pool }
+  , out{ out }
+  , image{ opts.image_location,
+           opts.verify || opts.dump || !opts.undelete_dir.empty() ||
+               opts.links == link_check::report
+             ? image_access::read_only
+             : image_access::read_write }
+  , super_block{ image.super_block() }
+  , geo{ image }
+  , block_size{ geo.block_size() }
+  , kernels{ dispatch_block_size(
+      block_size,
+      [](auto size) { return kernel_table::make<decltype(size)::value>(); }) }
+  , staged{ image, block_size, &stats.io }
+{
+    // a walk reads each indirect block once unless it is cross-linked,
+    // which takes a damaged image, and only those are worth repairing
+    if (opts.repair_pointers && opts.indirect_cache_mib > 0)
+    {
+        indirect.emplace(image,
+                         block_size,
+                         geo.block_count(),
+                         u64{ opts.indirect_cache_mib } << 20,
+                         &stats.indirect);
+    }
+    stats.lap(recovery_phase::geometry);
+}
+
+template<u64 BlockSize>
+recext2fs::kernel_table recext2fs::kernel_table::make() noexcept
+{
+    return { &recext2fs::scan_block_bitmap_kernel<BlockSize>,
+             &recext2fs::scan_inode_bitmap_kernel<BlockSize>,
+             &recext2fs::block_bitmap_from_set_kernel<BlockSize>,
+             &recext2fs::locate_orphan_blocks_kernel<BlockSize>,
+             &recext2fs::mark_indirect_blocks_kernel<BlockSize> };
+}
+
+bool recext2fs::recover_bitmap() noexcept
+{
+    bool const ok{ recover() };
+    if (!opts.stats_path.empty())
+    {
+        report_stats();
+    }
+    return ok;
+}
+
+bool recext2fs::recover() noexcept
+{
+    read_super_block();
+    if (opts.dump)
+    {
+        dump_metadata(image, geo, pool, *opts.dump, out);
+        stats.lap(recovery_phase::scan);
+        return static_cast<bool>(out);
+    }
+    u32 const groups{ geo.group_count() };
+    if (opts.print_metadata)
+    {
+        print_super_block(&this->super_block);
+        for (u32 i{ 0 }; i < groups; ++i)
+        {
+            print_group_descriptor(&read_block_group_desc(i));
+        }
+    }
+    stats.lap(recovery_phase::geometry);
+
+    if (!opts.undelete_dir.empty())
+    {
+        block_set const live{ collect_used_blocks() };
+        stats.lap(recovery_phase::scan);
+        bool const ok{ undelete_inodes(live) };
+        stats.lap(recovery_phase::flush);
+        return ok;
+    }
+    if (opts.links != link_check::none)
+    {
+        return check_links();
+    }
+    open_fingerprints();
+
+    std::optional<block_set> used;
+    std::vector<damaged_inode> damaged;
+    if (opts.mode == rebuild_mode::pointers || opts.list_orphans ||
+        opts.repair_pointers)
+    {
+        std::vector<cross_link> cross_links;
+        used.emplace(collect_used_blocks(&damaged, &cross_links));
+        print_cross_links(cross_links);
+    }
+    if (opts.list_orphans || opts.repair_pointers)
+    {
+        orphan_blocks orphans{ locate_orphans(pool, *used) };
+        if (opts.list_orphans)
+        {
+            print_orphans(orphans);
+        }
+        if (opts.repair_pointers)
+        {
+            repair_pointers(orphans, damaged, *used);
+        }
+    }
+    if (opts.mode != rebuild_mode::pointers)
+    {
+        used.reset();
+    }
+    stats.lap(recovery_phase::scan);
+    if (opts.verify)
     {
-        std::cerr << "Usage: " << argv[0]
-                  << " <image_location> <data_identifier>" << std::endl;
-        throw std::invalid_argument("Invalid number of arguments");
+        bool const same{ verify_bitmaps(pool, used ? &*used : nullptr) };
+        save_fingerprints();
+        stats.lap(recovery_phase::rebuild);
+        return same;
     }
-    image_location = std::string{ argv[1] };
-    data_identifier = parse_identifier(argc, argv);
 
-    image.open(image_location,
-               std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+    checkpoint journal{ opts.image_location + ".checkpoint",
+                        { image.size(),
+                          geo.block_count(),
+                          this->super_block.inode_count,
+                          geo.blocks_per_group(),
+                          groups } };
+    if (opts.resume && journal.load())
+    {
+        out << "resuming, " << journal.done_count() << " of " << groups
+            << " groups already rebuilt" << std::endl;
+    }
 
-    if (!image.is_open())
+    std::vector<u64> free_blocks(groups, 0);
+    std::vector<u64> free_inodes(groups, 0);
+    std::vector<u32> pending;
+    for (u32 bg_num{ 0 }; bg_num < groups; ++bg_num)
     {
-        std::cerr << "Could not open the image: " << image_location
+        if (!journal.done(bg_num))
+        {
+            pending.emplace_back(bg_num);
+            continue;
+        }
+        // a finished group's descriptor already holds its counts
+        u64 const descriptor{ geo.descriptor_offset(bg_num) };
+        free_blocks[bg_num] = staged.read<std::uint16_t>(
+          descriptor + offsetof(ext2_block_group_descriptor, free_block_count));
+        free_inodes[bg_num] = staged.read<std::uint16_t>(
+          descriptor + offsetof(ext2_block_group_descriptor, free_inode_count));
+    }
+
+    // groups own disjoint bitmap blocks, so they can be rebuilt in any order.
+    // They are flushed and recorded in batches, a rerun with --resume only
+    // redoes the batch that was interrupted.
+    for (u64 first{ 0 }; first < pending.size(); first += checkpoint_groups)
+    {
+        u32 const count{ static_cast<u32>(
+          std::min<u64>(checkpoint_groups, pending.size() - first)) };
+        pool.for_each(count,
+                      [&](u32 i)
+                      {
+                          u32 const bg_num{ pending[first + i] };
+                          rebuild_group(bg_num,
+                                        used ? &*used : nullptr,
+                                        free_blocks[bg_num],
+                                        free_inodes[bg_num]);
+                      });
+        stats.lap(recovery_phase::rebuild);
+        if (opts.dry_run)
+        {
+            continue;
+        }
+        if (!staged.flush() || !staged.sync())
+        {
+            std::cerr << "Could not write back block groups, stopping"
+                      << std::endl;
+            return false;
+        }
+        for (u32 i{ 0 }; i < count; ++i)
+        {
+            journal.mark(pending[first + i]);
+        }
+        journal.save();
+        stats.lap(recovery_phase::flush);
+    }
+    store_free_counts(
+      std::accumulate(free_blocks.begin(), free_blocks.end(), u64{ 0 }),
+      std::accumulate(free_inodes.begin(), free_inodes.end(), u64{ 0 }));
+    save_fingerprints();
+    stats.lap(recovery_phase::rebuild);
+
+    if (opts.dry_run)
+    {
+        out << "dry run, " << staged.dirty_blocks()
+            << " blocks left unwritten" << std::endl;
+        return true;
+    }
+    bool const written{ staged.flush() && staged.sync() };
+    stats.lap(recovery_phase::flush);
+    if (!written)
+    {
+        std::cerr << "Could not write back every recovered block" << std::endl;
+        return false;
+    }
+    journal.remove();
+    return true;
+}
+
+void recext2fs::report_stats() const noexcept
+{
+    if (opts.stats_path == "-")
+    {
+        stats.write_json(out, opts.image_location, opts.threads);
+        out << std::endl;
+        return;
+    }
+    std::ofstream file{ opts.stats_path };
+    stats.write_json(file, opts.image_location, opts.threads);
+    file << std::endl;
+    if (!file)
+    {
+        std::cerr << "Could not write statistics to " << opts.stats_path
                   << std::endl;
-        throw std::invalid_argument(image_location);
     }
 }
 
-std::vector<u8> recext2fs::parse_identifier(int argc, char* argv[]) noexcept
+void recext2fs::open_fingerprints() noexcept
+{
+    if (!opts.fingerprints)
+    {
+        return;
+    }
+    std::string const path{ opts.fingerprints->empty()
+                              ? opts.image_location + ".fingerprints"
+                              : *opts.fingerprints };
+    prints.emplace(path,
+                   fingerprint_index::describe(image.descriptor(),
+                                               this->block_size,
+                                               geo.block_count(),
+                                               opts.data_identifier));
+    if (prints->load())
+    {
+        out << "using block fingerprints from " << path << std::endl;
+    }
+    else if (!prints->create())
+    {
+        prints.reset();
+    }
+}
+
+void recext2fs::save_fingerprints() noexcept
 {
-    int identifier_length{ argc - 2 };
-    std::vector<u8> identifier;
-    for (int i{ 0 }; i < identifier_length; ++i)
+    // a sidecar is only published when the content scan covered every group
+    if (prints && prints->recording() &&
+        recorded_groups.load() == geo.group_count())
     {
-        unsigned temp{ 0 };
-        sscanf(argv[i + 2], "%x", &temp);
-        identifier.emplace_back(temp);
+        prints->commit();
     }
-    return identifier;
 }
 
-void recext2fs::recover_bitmap() noexcept
+bool recext2fs::verify_bitmaps(worker_pool& pool,
+                               const block_set* used) noexcept
 {
-    read_super_block();
-    print_super_block(&this->super_block);
+    struct group_diff
+    {
+        std::vector<bit_range> blocks;
+        std::vector<bit_range> inodes;
+    };
+    u32 const groups{ geo.group_count() };
+    std::vector<group_diff> diffs(groups);
+    pool.for_each(groups,
+                  [&](u32 bg_num)
+                  {
+                      group_layout const& layout{ geo.group(bg_num) };
+                      u32 directories{ 0 };
+                      std::vector<u8> const inode_bitmap{ scan_inode_bitmap(
+                        bg_num, directories) };
+                      std::vector<u8> const block_bitmap{
+                          used != nullptr ? block_bitmap_from_set(bg_num, *used)
+                                          : scan_block_bitmap(bg_num)
+                      };
+                      diffs[bg_num].blocks =
+                        differing_bits(image.block(layout.block_bitmap),
+                                       block_bitmap,
+                                       layout.block_count);
+                      diffs[bg_num].inodes =
+                        differing_bits(image.block(layout.inode_bitmap),
+                                       inode_bitmap,
+                                       geo.inodes_per_group());
+                  });
 
-    ext2_block_group_descriptor bg{ read_block_group_desc(0) };
-    print_group_descriptor(&bg);
+    // ranges are printed as absolute block and inode numbers, inclusive
+    u64 blocks{ 0 };
+    u64 inodes{ 0 };
+    u32 mismatched{ 0 };
+    for (u32 bg_num{ 0 }; bg_num < groups; ++bg_num)
+    {
+        group_diff const& diff{ diffs[bg_num] };
+        u64 const first_block{ geo.group(bg_num).first_block };
+        u64 const first_inode{ static_cast<u64>(bg_num) *
+                                 geo.inodes_per_group() +
+                               1 };
+        for (bit_range const& range : diff.blocks)
+        {
+            out << "group " << bg_num << " block bitmap differs for blocks "
+                << first_block + range.first << "-"
+                << first_block + range.end - 1 << std::endl;
+            blocks += range.end - range.first;
+        }
+        for (bit_range const& range : diff.inodes)
+        {
+            out << "group " << bg_num << " inode bitmap differs for inodes "
+                << first_inode + range.first << "-"
+                << first_inode + range.end - 1 << std::endl;
+            inodes += range.end - range.first;
+        }
+        mismatched += !diff.blocks.empty() || !diff.inodes.empty();
+    }
+    if (mismatched == 0)
+    {
+        out << "verify: bitmaps match" << std::endl;
+        return true;
+    }
+    out << "verify: " << blocks << " blocks and " << inodes
+        << " inodes differ in " << mismatched << " groups" << std::endl;
+    return false;
+}
 
-    // go to block bitmap
-    image.seekg(get_block_position(0, bg.block_bitmap));
-    char bits{ 0 };
-    for (u32 i{ 0 }; i < this->super_block.blocks_per_group; ++i)
+void recext2fs::rebuild_group(u32 bg_num,
+                              const block_set* used,
+                              u64& free_blocks,
+                              u64& free_inodes) noexcept
+{
+    group_layout const& layout{ geo.group(bg_num) };
+    u32 directories{ 0 };
+    std::vector<u8> const inode_bitmap{ scan_inode_bitmap(bg_num,
+                                                          directories) };
+    std::vector<u8> const block_bitmap{
+        used != nullptr ? block_bitmap_from_set(bg_num, *used)
+                        : scan_block_bitmap(bg_num)
+    };
+    store_bitmap(layout.inode_bitmap, inode_bitmap);
+    store_bitmap(layout.block_bitmap, block_bitmap);
+    free_blocks =
+      layout.block_count - count_set_bits(block_bitmap, layout.block_count);
+    free_inodes = geo.inodes_per_group() -
+                  count_set_bits(inode_bitmap, geo.inodes_per_group());
+    store_group_counts(bg_num, free_blocks, free_inodes, directories);
+}
+
+void recext2fs::store_bitmap(u32 b_num,
+                             const std::vector<u8>& bitmap) noexcept
+{
+    staged.stage(b_num, bitmap);
+}
+
+void recext2fs::store_group_counts(u32 bg_num,
+                                   u64 free_blocks,
+                                   u64 free_inodes,
+                                   u32 directories) noexcept
+{
+    // descriptor fields are 16 bits wide
+    u64 const descriptor{ geo.descriptor_offset(bg_num) };
+    staged.write(
+      descriptor + offsetof(ext2_block_group_descriptor, free_block_count),
+      static_cast<std::uint16_t>(free_blocks));
+    staged.write(
+      descriptor + offsetof(ext2_block_group_descriptor, free_inode_count),
+      static_cast<std::uint16_t>(free_inodes));
+    staged.write(
+      descriptor + offsetof(ext2_block_group_descriptor, used_dirs_count),
+      static_cast<std::uint16_t>(directories));
+}
+
+void recext2fs::store_free_counts(u64 free_blocks, u64 free_inodes) noexcept
+{
+    // only the primary super block, e2fsck never trusts the backup counts
+    staged.write(EXT2_SUPER_BLOCK_POSITION +
+                   offsetof(ext2_super_block, free_block_count),
+                 static_cast<u32>(free_blocks));
+    staged.write(EXT2_SUPER_BLOCK_POSITION +
+                   offsetof(ext2_super_block, free_inode_count),
+                 static_cast<u32>(free_inodes));
+}
+
+template<u64 BlockSize>
+std::vector<u8> recext2fs::scan_inode_bitmap_kernel(
+  u32 bg_num,
+  u32& directories) const noexcept
+{
+    u64 const size{ fixed_block_size<BlockSize>(this->block_size) };
+    std::vector<u8> bitmap(size, 0xff);
+    u32 const per_group{ geo.inodes_per_group() };
+    u32 const per_block{ static_cast<u32>(size / geo.inode_size()) };
+    // inodes below first_inode are reserved and always in use
+    u32 const first_inode{ geo.first_inode() };
+    u32 const first_in_group{ bg_num * per_group + 1 };
+
+    for (u32 first{ 0 }; first < per_group; first += per_block)
     {
-        std::fstream block{ image_location };
-        pos curr_pos{ get_block_position(0, i) };
-        block.seekg(curr_pos);
-        for (u32 j{ 0 }; j < this->block_size; ++j)
+        // one whole inode table block per iteration
+        std::span<const u8> const block{ image.block(
+          geo.group(bg_num).inode_table + first / per_block) };
+        u32 const count{ std::min(per_block, per_group - first) };
+        for (u32 j{ 0 }; j < count; ++j)
         {
-            char temp{ 0 };
-            block.read(&temp, 1);
-            if (temp != 0)
+            auto const& inode{ *reinterpret_cast<const ext2_inode*>(
+              block.data() + static_cast<u64>(j) * geo.inode_size()) };
+            u32 const i{ first + j };
+            bool const live{ (inode.mode != 0 && inode.deletion_time == 0) ||
+                             first_in_group + i < first_inode };
+            if (!live)
+            {
+                bitmap[i / 8] &= static_cast<u8>(~(1U << (i % 8)));
+            }
+            else if ((inode.mode & 0xf000U) == EXT2_I_DTYPE)
             {
-                bits |= (1 << (i % 8));
-                break;
+                ++directories;
             }
         }
-        if (i > 0 && i % 8 == 0)
+    }
+    return bitmap;
+}
+
+template<u64 BlockSize>
+std::vector<u8> recext2fs::scan_block_bitmap_kernel(u32 bg_num) noexcept
+{
+    u64 const size{ fixed_block_size<BlockSize>(this->block_size) };
+    // bits past the last block of the group stay set, as mke2fs leaves them
+    std::vector<u8> bitmap(size, 0xff);
+    group_layout const& layout{ geo.group(bg_num) };
+    u32 const blocks{ layout.block_count };
+    // super block copy, descriptor table, bitmaps and the inode table are
+    // always in use even when they happen to hold only zeros
+    u32 const metadata_end{ layout.metadata_end - layout.first_block };
+
+    std::array<u64, 3> classified{};
+    u64 holes{ 0 };
+    if (prints && prints->current())
+    {
+        // the image has not changed since the sidecar was recorded
+        for (u32 i{ metadata_end }; i < blocks; ++i)
         {
-            char temp{ bits };
-            for (u32 j{ 0 }; j < 8; ++j)
+            block_class const outcome{
+                prints->at(layout.first_block + i).kind
+            };
+            ++classified[static_cast<std::size_t>(outcome)];
+            if (outcome == block_class::empty)
             {
-                temp |= ((bits & (1 << i)) << (7 - i));
+                bitmap[i / 8] &= static_cast<u8>(~(1U << (i % 8)));
             }
-            static_assert(sizeof(bits) == 1);
-            image.write(&bits, sizeof(bits));
-            bits = 0;
         }
+        for (block_class outcome : { block_class::empty,
+                                     block_class::identifier,
+                                     block_class::nonzero })
+        {
+            stats.add_classified(
+              outcome, classified[static_cast<std::size_t>(outcome)]);
+        }
+        return bitmap;
     }
+    // while recording, metadata blocks are classified as well so the
+    // sidecar covers the whole group
+    bool const recording{ prints && prints->recording() };
+
+    block_scanner scanner{ image.descriptor(),
+                           size,
+                           std::min(block_scanner::default_chunk_size,
+                                    blocks * size),
+                           &stats.io };
+    bool const ok{ scanner.scan(
+      geo.block_offset(layout.first_block),
+      blocks,
+      [&](u64 i, std::span<const u8> block)
+      {
+          if (i < metadata_end && !recording)
+          {
+              return;
+          }
+          std::span<const u8> const data{ block.data(), size };
+          block_class const outcome{ classify_block<BlockSize>(
+            data, opts.data_identifier) };
+          if (recording)
+          {
+              prints->record(layout.first_block + static_cast<u32>(i),
+                             outcome);
+          }
+          if (i < metadata_end)
+          {
+              return;
+          }
+          ++classified[static_cast<std::size_t>(outcome)];
+          if (outcome == block_class::empty)
+          {
+              bitmap[i / 8] &= static_cast<u8>(~(1U << (i % 8)));
+          }
+      },
+      [&](u64 first, u64 count)
+      {
+          // holes in the image file read as zeros, so they are free
+          holes += count;
+          for (u64 i{ std::max<u64>(first, metadata_end) }; i < first + count;
+               ++i)
+          {
+              bitmap[i / 8] &= static_cast<u8>(~(1U << (i % 8)));
+          }
+          if (recording)
+          {
+              for (u64 i{ first }; i < first + count; ++i)
+              {
+                  prints->record(layout.first_block + static_cast<u32>(i),
+                                 block_class::empty);
+              }
+          }
+      }) };
+    if (ok && recording)
+    {
+        recorded_groups.fetch_add(1);
+    }
+    for (block_class outcome :
+         { block_class::empty, block_class::identifier, block_class::nonzero })
+    {
+        stats.add_classified(outcome,
+                             classified[static_cast<std::size_t>(outcome)]);
+    }
+    stats.add_holes(holes);
+    if (!ok)
+    {
+        std::cerr << "Could not scan block group " << bg_num << std::endl;
+        // leave everything marked used rather than freeing live blocks
+        std::fill(bitmap.begin(), bitmap.end(), 0xff);
+    }
+    return bitmap;
 }
 
-void recext2fs::read_super_block() noexcept
+template<u64 BlockSize>
+std::vector<u8> recext2fs::block_bitmap_from_set_kernel(
+  u32 bg_num,
+  const block_set& used) const noexcept
 {
-    pos curr_pos{ 0 };
-    // Skip the boot data
-    curr_pos += EXT2_BOOT_BLOCK_SIZE;
-    image.seekg(curr_pos);
+    u64 const size{ fixed_block_size<BlockSize>(this->block_size) };
+    std::vector<u8> bitmap(size, 0xff);
+    group_layout const& layout{ geo.group(bg_num) };
+    for (u32 i{ 0 }; i < layout.block_count; ++i)
+    {
+        if (!used.test(layout.first_block + i))
+        {
+            bitmap[i / 8] &= static_cast<u8>(~(1U << (i % 8)));
+        }
+    }
+    return bitmap;
+}
 
-    // read onto superblock
-    image.read(reinterpret_cast<char*>(&this->super_block),
-               sizeof(ext2_super_block));
+orphan_blocks recext2fs::locate_orphans(worker_pool& pool,
+                                        const block_set& referenced) noexcept
+{
+    u32 const groups{ geo.group_count() };
+    std::vector<std::vector<u32>> data(groups);
+    std::vector<std::vector<u32>> untagged(groups);
+    pool.for_each(groups,
+                  [&](u32 bg_num)
+                  {
+                      locate_orphan_blocks(
+                        bg_num, referenced, data[bg_num], untagged[bg_num]);
+                  });
 
-    this->block_size = EXT2_UNLOG(this->super_block.log_block_size);
+    auto const flatten{ [](std::vector<std::vector<u32>>& per_group)
+                        {
+                            std::vector<u32> all;
+                            for (auto& blocks : per_group)
+                            {
+                                all.insert(
+                                  all.end(), blocks.begin(), blocks.end());
+                            }
+                            return all;
+                        } };
+    return { orphan_index{ this->super_block.block_count, flatten(data) },
+             orphan_index{ this->super_block.block_count,
+                           flatten(untagged) } };
 }
 
-ext2_block_group_descriptor recext2fs::read_block_group_desc(
-  u32 bg_num) noexcept
+void recext2fs::print_orphans(const orphan_blocks& orphans) const noexcept
+{
+    out << "orphaned identifier blocks: " << orphans.data.size() << std::endl;
+    for (u32 b : orphans.data.blocks())
+    {
+        out << b << std::endl;
+    }
+    out << "orphaned untagged blocks: " << orphans.untagged.size() << std::endl;
+    for (u32 b : orphans.untagged.blocks())
+    {
+        out << b << std::endl;
+    }
+}
+
+bool recext2fs::undelete_inodes(const block_set& used) noexcept
+{
+    if (mkdir(opts.undelete_dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        std::cerr << "Could not create " << opts.undelete_dir << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+    undelete_scanner scanner{
+        image, geo, used, opts.undelete_dir, &stats.io
+    };
+    u32 const groups{ geo.group_count() };
+    std::vector<std::vector<undelete_result>> results(groups);
+    pool.for_each(groups,
+                  [&](u32 bg_num)
+                  { results[bg_num] = scanner.scan_group(bg_num); });
+
+    constexpr const char* reasons[]{ "recovered",
+                                     "not a regular file",
+                                     "block pointers cleared",
+                                     "blocks reused",
+                                     "write failed" };
+    u64 deleted{ 0 };
+    u64 recovered{ 0 };
+    bool ok{ true };
+    for (auto const& group : results)
+    {
+        for (undelete_result const& result : group)
+        {
+            ++deleted;
+            out << "inode " << result.inode << " (" << result.size
+                << " bytes): "
+                << reasons[static_cast<std::size_t>(result.outcome)];
+            if (result.outcome == undelete_outcome::recovered)
+            {
+                ++recovered;
+                out << " to " << scanner.output_path(result.inode);
+            }
+            out << std::endl;
+            ok = ok && result.outcome != undelete_outcome::write_failed;
+        }
+    }
+    out << "undeleted " << recovered << " of " << deleted
+        << " deleted inodes" << std::endl;
+    return ok;
+}
+
+bool recext2fs::check_links() noexcept
+{
+    directory_walker const walker{ image, geo };
+    link_census const census{ walker.walk(pool) };
+    stats.lap(recovery_phase::scan);
+    out << "walked " << census.directories << " directories, "
+        << census.entries << " entries" << std::endl;
+
+    // reserved inodes other than the root are not part of the tree
+    u32 const first_inode{ this->super_block.rev_level == 0
+                             ? 11
+                             : this->super_block.first_inode };
+    u64 wrong{ 0 };
+    u64 unreachable{ 0 };
+    for (u32 ino{ EXT2_ROOT_INODE }; ino <= walker.inode_count(); ++ino)
+    {
+        ext2_inode const& node{ walker.inode(ino) };
+        if ((ino != EXT2_ROOT_INODE && ino < first_inode) || node.mode == 0 ||
+            node.deletion_time != 0)
+        {
+            continue;
+        }
+        u32 const found{ census.references[ino] };
+        if (found == 0)
+        {
+            // nothing to count links from, fsck would move it to lost+found
+            out << "inode " << ino << ": unreachable, link count "
+                << node.link_count << std::endl;
+            ++unreachable;
+            continue;
+        }
+        if (found == node.link_count)
+        {
+            continue;
+        }
+        out << "inode " << ino << ": link count " << node.link_count
+            << ", " << found << " references" << std::endl;
+        ++wrong;
+        if (opts.links == link_check::fix)
+        {
+            u32 const bg_num{ (ino - 1) / geo.inodes_per_group() };
+            u32 const index{ (ino - 1) % geo.inodes_per_group() };
+            staged.write(geo.inode_offset(bg_num, index) +
+                           offsetof(ext2_inode, link_count),
+                         static_cast<std::uint16_t>(found));
+        }
+    }
+    out << "link counts: " << wrong << " wrong, " << unreachable
+        << " unreachable" << std::endl;
+    stats.lap(recovery_phase::rebuild);
+    if (opts.links == link_check::report)
+    {
+        return wrong == 0 && unreachable == 0;
+    }
+    if (opts.dry_run)
+    {
+        out << "dry run, " << staged.dirty_blocks()
+            << " blocks left unwritten" << std::endl;
+        return true;
+    }
+    bool const written{ staged.flush() && staged.sync() };
+    stats.lap(recovery_phase::flush);
+    if (!written)
+    {
+        std::cerr << "Could not write back the link counts" << std::endl;
+    }
+    return written;
+}
+
+void recext2fs::repair_pointers(orphan_blocks& orphans,
+                                const std::vector<damaged_inode>& damaged,
+                                block_set& used) noexcept
+{
+    pointer_repair repair{ staged, geo, orphans, used };
+    u32 restored{ 0 };
+    // only the inodes the walk found short of blocks are revisited
+    for (damaged_inode const& inode : damaged)
+    {
+        u32 const bg_num{ (inode.number - 1) / geo.inodes_per_group() };
+        u32 const index{ (inode.number - 1) % geo.inodes_per_group() };
+        restored += repair.repair(inode, geo.inode_offset(bg_num, index));
+    }
+    out << "restored " << restored << " pointers in " << damaged.size()
+        << " inodes" << std::endl;
+}
+
+template<u64 BlockSize>
+void recext2fs::locate_orphan_blocks_kernel(
+  u32 bg_num,
+  const block_set& referenced,
+  std::vector<u32>& data,
+  std::vector<u32>& untagged) noexcept
+{
+    u64 const size{ fixed_block_size<BlockSize>(this->block_size) };
+    group_layout const& layout{ geo.group(bg_num) };
+    u32 const blocks{ layout.block_count };
+    std::span<const u8> const identifier{ opts.data_identifier };
+    std::array<u64, 3> classified{};
+    u64 holes{ 0 };
+    if (prints && prints->current())
+    {
+        for (u32 b{ layout.first_block }; b < layout.first_block + blocks; ++b)
+        {
+            if (referenced.test(b))
+            {
+                continue;
+            }
+            block_class const outcome{ prints->at(b).kind };
+            ++classified[static_cast<std::size_t>(outcome)];
+            if (outcome == block_class::identifier)
+            {
+                data.emplace_back(b);
+            }
+            else if (outcome == block_class::nonzero)
+            {
+                untagged.emplace_back(b);
+            }
+        }
+        for (block_class outcome : { block_class::empty,
+                                     block_class::identifier,
+                                     block_class::nonzero })
+        {
+            stats.add_classified(
+              outcome, classified[static_cast<std::size_t>(outcome)]);
+        }
+        return;
+    }
+
+    block_scanner scanner{ image.descriptor(),
+                           size,
+                           std::min(block_scanner::default_chunk_size,
+                                    blocks * size),
+                           &stats.io };
+    bool const ok{ scanner.scan_chunks(
+      geo.block_offset(layout.first_block),
+      blocks,
+      [&](u64 first, const u8* chunk, u64 count)
+      {
+          for (u64 i{ 0 }; i < count; i += 64)
+          {
+              u32 const n{ static_cast<u32>(std::min<u64>(64, count - i)) };
+              u64 const hits{ identifier_prefilter<BlockSize>(
+                chunk + i * size, size, n, identifier) };
+              for (u32 j{ 0 }; j < n; ++j)
+              {
+                  u32 const b_num{ layout.first_block +
+                                   static_cast<u32>(first + i + j) };
+                  if (referenced.test(b_num))
+                  {
+                      continue;
+                  }
+                  std::span<const u8> const block{ chunk + (i + j) * size,
+                                                   size };
+                  if ((hits >> j) & 1U && has_identifier(block, identifier))
+                  {
+                      data.emplace_back(b_num);
+                      ++classified[static_cast<std::size_t>(
+                        block_class::identifier)];
+                      continue;
+                  }
+                  block_class const outcome{ classify_block<BlockSize>(
+                    block, {}) };
+                  ++classified[static_cast<std::size_t>(outcome)];
+                  if (outcome != block_class::empty)
+                  {
+                      untagged.emplace_back(b_num);
+                  }
+              }
+          }
+      },
+      [&](u64, u64 count)
+      {
+          // blocks in a hole are empty, never orphans
+          holes += count;
+      }) };
+    for (block_class outcome :
+         { block_class::empty, block_class::identifier, block_class::nonzero })
+    {
+        stats.add_classified(outcome,
+                             classified[static_cast<std::size_t>(outcome)]);
+    }
+    stats.add_holes(holes);
+    if (!ok)
+    {
+        std::cerr << "Could not scan block group " << bg_num << std::endl;
+    }
+}
+
+block_set recext2fs::collect_used_blocks(
+  std::vector<damaged_inode>* damaged,
+  std::vector<cross_link>* cross_links) noexcept
+{
+    struct group_walk
+    {
+        std::vector<damaged_inode> damaged;
+        std::vector<u32> repeated;
+    };
+    atomic_block_set used{ this->super_block.block_count };
+    u32 const groups{ geo.group_count() };
+    std::vector<group_walk> walks(groups);
+    // metadata is claimed up front so the resize inode below always finds
+    // its reserved descriptor blocks taken already
+    pool.for_each(groups,
+                  [&](u32 bg_num)
+                  {
+                      block_claims claims{ used, {} };
+                      mark_metadata_blocks(bg_num, claims);
+                      walks[bg_num].repeated = std::move(claims.repeated);
+                  });
+    // every claim is one fetch_or, the thread that sets a bit second is the
+    // one that records the block as claimed twice
+    pool.for_each(groups,
+                  [&](u32 bg_num)
+                  {
+                      block_claims claims{ used,
+                                           std::move(walks[bg_num].repeated) };
+                      for (inode_view const& node :
+                           inode_range{ image, geo, bg_num })
+                      {
+                          if (!node.live())
+                          {
+                              continue;
+                          }
+                          auto const before{ claims.repeated.size() };
+                          u64 const reached{ mark_inode_blocks(node.inode(),
+                                                               claims) };
+                          if (node.number == EXT2_RESIZE_INODE)
+                          {
+                              // it owns the reserved descriptor blocks the
+                              // metadata of its group already claimed
+                              auto const first{ claims.repeated.begin() +
+                                                before };
+                              claims.repeated.erase(
+                                std::remove_if(first,
+                                               claims.repeated.end(),
+                                               [this](u32 b)
+                                               {
+                                                   return geo.is_metadata(b);
+                                               }),
+                                claims.repeated.end());
+                          }
+                          u64 const expected{ expected_blocks(node.inode()) };
+                          if (reached < expected)
+                          {
+                              walks[bg_num].damaged.push_back(
+                                { node.number, expected - reached });
+                          }
+                      }
+                      walks[bg_num].repeated = std::move(claims.repeated);
+                  });
+
+    std::vector<u32> repeated;
+    for (group_walk& walk : walks)
+    {
+        if (damaged != nullptr)
+        {
+            damaged->insert(
+              damaged->end(), walk.damaged.begin(), walk.damaged.end());
+        }
+        repeated.insert(
+          repeated.end(), walk.repeated.begin(), walk.repeated.end());
+    }
+    if (cross_links != nullptr && !repeated.empty())
+    {
+        *cross_links = find_owners(repeated);
+    }
+    return used.snapshot();
+}
+
+std::vector<cross_link> recext2fs::find_owners(
+  const std::vector<u32>& repeated) noexcept
+{
+    // only runs when the walk saw a block twice, so it can afford a second
+    // pass that collects every owner of those blocks
+    block_set wanted{ this->super_block.block_count };
+    for (u32 b : repeated)
+    {
+        wanted.set(b);
+    }
+    u32 const groups{ geo.group_count() };
+    std::vector<std::vector<std::pair<u32, u32>>> found(groups);
+    pool.for_each(
+      groups,
+      [&](u32 bg_num)
+      {
+          group_layout const& layout{ geo.group(bg_num) };
+          for (u32 b{ layout.first_block };
+               b < layout.metadata_end && b < wanted.size();
+               ++b)
+          {
+              if (wanted.test(b))
+              {
+                  found[bg_num].emplace_back(b, 0);
+              }
+          }
+          for (inode_view const& node : inode_range{ image, geo, bg_num })
+          {
+              if (!node.live())
+              {
+                  continue;
+              }
+              for (block_view const& block :
+                   inode_block_range{ image, geo, node.inode(), true })
+              {
+                  if (wanted.test(block.number))
+                  {
+                      found[bg_num].emplace_back(block.number, node.number);
+                  }
+              }
+          }
+      });
+
+    std::vector<std::pair<u32, u32>> owners;
+    for (auto const& group : found)
+    {
+        owners.insert(owners.end(), group.begin(), group.end());
+    }
+    std::sort(owners.begin(), owners.end());
+    std::vector<cross_link> cross_links;
+    for (auto const& [b, owner] : owners)
+    {
+        if (cross_links.empty() || cross_links.back().block != b)
+        {
+            cross_links.push_back({ b, {} });
+        }
+        cross_links.back().owners.emplace_back(owner);
+    }
+    return cross_links;
+}
+
+void recext2fs::print_cross_links(
+  const std::vector<cross_link>& cross_links) const noexcept
+{
+    if (cross_links.empty())
+    {
+        return;
+    }
+    out << "cross-linked blocks: " << cross_links.size() << std::endl;
+    for (cross_link const& link : cross_links)
+    {
+        out << link.block << ":";
+        for (u32 owner : link.owners)
+        {
+            if (owner == 0)
+            {
+                out << " metadata";
+            }
+            else
+            {
+                out << " " << owner;
+            }
+        }
+        out << std::endl;
+    }
+}
+
+void recext2fs::mark_metadata_blocks(u32 bg_num,
+                                     block_claims& claims) const noexcept
+{
+    group_layout const& layout{ geo.group(bg_num) };
+    for (u32 b{ layout.first_block };
+         b < layout.metadata_end && b < claims.used.size();
+         ++b)
+    {
+        claims.claim(b);
+    }
+}
+
+u64 recext2fs::mark_inode_blocks(const ext2_inode& inode,
+                                 block_claims& claims) const noexcept
+{
+    // fast symlinks keep the target in the pointer array itself
+    if ((inode.mode & 0xf000) == 0xA000 && inode.block_count_512 == 0)
+    {
+        return 0;
+    }
+    u64 reached{ 0 };
+    for (u32 b : inode.direct_blocks)
+    {
+        if (b != 0 && b < claims.used.size())
+        {
+            claims.claim(b);
+            ++reached;
+        }
+    }
+    reached += mark_indirect_blocks(inode.single_indirect, 1, claims);
+    reached += mark_indirect_blocks(inode.double_indirect, 2, claims);
+    reached += mark_indirect_blocks(inode.triple_indirect, 3, claims);
+    return reached;
+}
+
+u64 recext2fs::expected_blocks(const ext2_inode& inode) const noexcept
 {
-    pos curr_pos{ 0 };
+    if ((inode.mode & 0xf000) == 0xA000 && inode.block_count_512 == 0)
+    {
+        return 0;
+    }
+    // block_count_512 counts data and indirect blocks, as the walk does.
+    // The size says nothing: holes of sparse files are not damage.
+    return inode.block_count_512 / (this->block_size / 512);
+}
 
-    curr_pos += get_block_group_position(bg_num);
-    image.seekg(curr_pos);
+std::vector<u8> recext2fs::scan_block_bitmap(u32 bg_num) noexcept
+{
+    return (this->*kernels.scan_block_bitmap)(bg_num);
+}
+
+std::vector<u8> recext2fs::scan_inode_bitmap(u32 bg_num,
+                                             u32& directories) const noexcept
+{
+    return (this->*kernels.scan_inode_bitmap)(bg_num, directories);
+}
 
-    ext2_block_group_descriptor block_group{};
-    // read onto block group
-    image.read(reinterpret_cast<char*>(&block_group),
-               sizeof(ext2_block_group_descriptor));
+std::vector<u8> recext2fs::block_bitmap_from_set(
+  u32 bg_num,
+  const block_set& used) const noexcept
+{
+    return (this->*kernels.block_bitmap_from_set)(bg_num, used);
+}
 
-    return block_group;
+void recext2fs::locate_orphan_blocks(u32 bg_num,
+                                     const block_set& referenced,
+                                     std::vector<u32>& data,
+                                     std::vector<u32>& untagged) noexcept
+{
+    (this->*kernels.locate_orphan_blocks)(bg_num, referenced, data, untagged);
 }
 
-i64 constexpr recext2fs::get_block_group_position(u32 bg_num) const noexcept
+u64 recext2fs::mark_indirect_blocks(u32 b_num,
+                                    u32 depth,
+                                    block_claims& claims) const noexcept
 {
-    u32 offset{ 0 };
-    if (bg_num == 0 || bg_num == 1 || bg_num % 3 == 0 || bg_num % 5 == 0 ||
-        bg_num % 7 == 0)
+    return (this->*kernels.mark_indirect_blocks)(b_num, depth, claims);
+}
+
+template<u64 BlockSize>
+u64 recext2fs::mark_indirect_blocks_kernel(u32 b_num,
+                                           u32 depth,
+                                           block_claims& claims) const noexcept
+{
+    if (b_num == 0 || b_num >= claims.used.size())
+    {
+        return 0;
+    }
+    claims.claim(b_num);
+    u64 reached{ 1 };
+
+    auto const follow{ [&](u32 b)
+                       {
+                           if (depth > 1)
+                           {
+                               reached += mark_indirect_blocks_kernel<
+                                 BlockSize>(b, depth - 1, claims);
+                           }
+                           else
+                           {
+                               claims.claim(b);
+                               ++reached;
+                           }
+                       } };
+    // only valid pointers are followed, the rest reach nothing
+    if (indirect)
+    {
+        for (u32 b : *indirect->pointers(b_num))
+        {
+            follow(b);
+        }
+        return reached;
+    }
+    // pointers per block is a constant for the specialised sizes
+    u64 const size{ fixed_block_size<BlockSize>(this->block_size) };
+    std::span<const u8> const block{ image.block(b_num) };
+    for (u64 i{ 0 }; i < size; i += sizeof(u32))
     {
-        // Super block exists for given block group
-        offset = EXT2_SUPER_BLOCK_SIZE;
+        u32 b;
+        std::memcpy(&b, block.data() + i, sizeof(u32));
+        if (b != 0 && b < claims.used.size())
+        {
+            follow(b);
+        }
     }
-    return get_block_position(bg_num, 0) + offset;
+    return reached;
+}
+
+void recext2fs::read_super_block() noexcept
+{
+    // the super block is a view into the image, only derive the sizes
+    this->block_size = geo.block_size();
 }
 
-i64 constexpr recext2fs::get_block_position(u32 bg_num,
-                                            u32 b_num) const noexcept
+ext2_block_group_descriptor& recext2fs::read_block_group_desc(
+  u32 bg_num) noexcept
 {
-    return static_cast<i64>(EXT2_BOOT_BLOCK_SIZE +
-                            bg_num * this->super_block.blocks_per_group *
-                              block_size +
-                            b_num * block_size);
+    return image.group_desc(geo.descriptor_offset(bg_num));
 }
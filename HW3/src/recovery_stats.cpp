@@ -0,0 +1,136 @@
+#include "recovery_stats.hpp"
+
+#include "block_classifier.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+using u64 = std::uint64_t;
+
+namespace
+{
+double wall_seconds() noexcept
+{
+    return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// CPU time of every thread of the process
+double cpu_seconds() noexcept
+{
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) +
+           static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+void write_string(std::ostream& out, const std::string& value)
+{
+    out << '"';
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                << static_cast<int>(c) << std::dec << std::setfill(' ');
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+constexpr const char* phase_names[]{ "open",
+                                     "geometry",
+                                     "scan",
+                                     "rebuild",
+                                     "flush" };
+} // namespace
+
+recovery_stats::recovery_stats() noexcept
+  : wall_mark{ wall_seconds() }
+  , cpu_mark{ cpu_seconds() }
+{
+}
+
+void recovery_stats::lap(recovery_phase phase) noexcept
+{
+    double const wall{ wall_seconds() };
+    double const cpu{ cpu_seconds() };
+    phase_time& time{ phases[static_cast<std::size_t>(phase)] };
+    time.wall += wall - wall_mark;
+    time.cpu += cpu - cpu_mark;
+    wall_mark = wall;
+    cpu_mark = cpu;
+}
+
+void recovery_stats::add(const recovery_stats& other) noexcept
+{
+    auto const merge{ [](std::atomic<u64>& into, const std::atomic<u64>& from)
+                      {
+                          into.fetch_add(from.load(std::memory_order_relaxed),
+                                         std::memory_order_relaxed);
+                      } };
+    merge(io.bytes_read, other.io.bytes_read);
+    merge(io.bytes_written, other.io.bytes_written);
+    merge(io.bytes_skipped, other.io.bytes_skipped);
+    merge(io.read_calls, other.io.read_calls);
+    merge(io.write_calls, other.io.write_calls);
+    merge(indirect.hits, other.indirect.hits);
+    merge(indirect.misses, other.indirect.misses);
+    merge(indirect.evictions, other.indirect.evictions);
+    for (std::size_t i{ 0 }; i < classified.size(); ++i)
+    {
+        merge(classified[i], other.classified[i]);
+    }
+    merge(hole_blocks, other.hole_blocks);
+    for (std::size_t i{ 0 }; i < phase_count; ++i)
+    {
+        phases[i].wall += other.phases[i].wall;
+        phases[i].cpu += other.phases[i].cpu;
+    }
+}
+
+void recovery_stats::write_json(std::ostream& out,
+                                const std::string& image,
+                                unsigned threads) const
+{
+    auto const load{ [](const std::atomic<u64>& value)
+                     { return value.load(std::memory_order_relaxed); } };
+    out << "{\"image\":";
+    write_string(out, image);
+    out << ",\"threads\":" << threads;
+    out << ",\"io\":{\"bytes_read\":" << load(io.bytes_read)
+        << ",\"bytes_written\":" << load(io.bytes_written)
+        << ",\"bytes_skipped\":" << load(io.bytes_skipped)
+        << ",\"read_calls\":" << load(io.read_calls)
+        << ",\"write_calls\":" << load(io.write_calls) << "}";
+    out << ",\"indirect_cache\":{\"hits\":" << load(indirect.hits)
+        << ",\"misses\":" << load(indirect.misses)
+        << ",\"evictions\":" << load(indirect.evictions) << "}";
+    out << ",\"blocks\":{\"empty\":"
+        << load(classified[static_cast<std::size_t>(block_class::empty)])
+        << ",\"identifier\":"
+        << load(classified[static_cast<std::size_t>(block_class::identifier)])
+        << ",\"nonzero\":"
+        << load(classified[static_cast<std::size_t>(block_class::nonzero)])
+        << ",\"hole\":" << load(hole_blocks) << "}";
+    out << ",\"phases\":{" << std::fixed << std::setprecision(6);
+    for (std::size_t i{ 0 }; i < phase_count; ++i)
+    {
+        out << (i == 0 ? "" : ",") << '"' << phase_names[i] << "\":{\"wall\":"
+            << phases[i].wall << ",\"cpu\":" << phases[i].cpu << "}";
+    }
+    out << "}}" << std::defaultfloat;
+}
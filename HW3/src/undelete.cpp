@@ -0,0 +1,212 @@
+#include "undelete.hpp"
+
+#include "block_set.hpp"
+#include "ext2_ranges.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+#include "recovery_stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <span>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+undelete_scanner::undelete_scanner(const mapped_image& image,
+                                   const geometry& geo,
+                                   const block_set& used,
+                                   std::string directory,
+                                   io_counters* counters) noexcept
+  : image{ image }
+  , geo{ geo }
+  , used{ used }
+  , directory{ std::move(directory) }
+  , counters{ counters }
+{
+}
+
+std::vector<undelete_result> undelete_scanner::scan_group(
+  u32 bg_num) const noexcept
+{
+    std::vector<undelete_result> results;
+    for (inode_view const& node : inode_range{ image, geo, bg_num })
+    {
+        ext2_inode const& inode{ node.inode() };
+        if (inode.mode == 0 || inode.deletion_time == 0)
+        {
+            continue;
+        }
+        undelete_result result{ node.number,
+                                inode.size,
+                                undelete_outcome::recovered };
+        u64 data_blocks{ 0 };
+        if ((inode.mode & 0xf000U) != EXT2_I_FTYPE)
+        {
+            result.outcome = undelete_outcome::not_a_file;
+        }
+        else if (!blocks_free(inode, data_blocks))
+        {
+            result.outcome = undelete_outcome::blocks_reused;
+        }
+        else if (data_blocks == 0 && inode.size != 0)
+        {
+            result.outcome = undelete_outcome::no_blocks;
+        }
+        else if (!extract(node.number, inode))
+        {
+            result.outcome = undelete_outcome::write_failed;
+        }
+        results.emplace_back(result);
+    }
+    return results;
+}
+
+std::string undelete_scanner::output_path(u32 ino) const
+{
+    return directory + "/inode-" + std::to_string(ino);
+}
+
+bool undelete_scanner::blocks_free(const ext2_inode& inode,
+                                   u64& data_blocks) const noexcept
+{
+    for (block_view const& block :
+         inode_block_range{ image, geo, inode, true })
+    {
+        if (used.test(block.number))
+        {
+            return false;
+        }
+        data_blocks += block.depth == 0 ? 1 : 0;
+    }
+    return true;
+}
+
+bool undelete_scanner::extract(u32 ino, const ext2_inode& inode) const noexcept
+{
+    std::string const path{ output_path(ino) };
+    int const out{ open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+    if (out < 0)
+    {
+        std::cerr << "Could not create " << path << ": "
+                  << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // runs of blocks consecutive both in the file and on disk are copied
+    // with one call; gaps between runs stay holes
+    u64 const block_size{ geo.block_size() };
+    u64 const size{ inode.size };
+    bool ok{ true };
+    u64 run_logical{ 0 };
+    u64 run_first{ 0 };
+    u64 run_blocks{ 0 };
+    auto const flush_run{ [&]
+                          {
+                              u64 const offset{ run_logical * block_size };
+                              if (run_blocks == 0 || offset >= size)
+                              {
+                                  return;
+                              }
+                              u64 const length{ std::min(
+                                run_blocks * block_size, size - offset) };
+                              ok = ok && copy_run(out,
+                                                  run_first * block_size,
+                                                  offset,
+                                                  length);
+                          } };
+    for (block_view const& block : inode_block_range{ image, geo, inode })
+    {
+        if (run_blocks != 0 && block.logical == run_logical + run_blocks &&
+            block.number == run_first + run_blocks)
+        {
+            ++run_blocks;
+            continue;
+        }
+        flush_run();
+        run_logical = block.logical;
+        run_first = block.number;
+        run_blocks = 1;
+    }
+    flush_run();
+
+    if (ok && ftruncate(out, static_cast<off_t>(size)) < 0)
+    {
+        std::cerr << "Could not size " << path << ": " << std::strerror(errno)
+                  << std::endl;
+        ok = false;
+    }
+    close(out);
+    return ok;
+}
+
+bool undelete_scanner::copy_run(int out,
+                                u64 from,
+                                u64 to,
+                                u64 length) const noexcept
+{
+    loff_t in_offset{ static_cast<loff_t>(from) };
+    loff_t out_offset{ static_cast<loff_t>(to) };
+    while (length > 0)
+    {
+        ssize_t const done{ copy_file_range(
+          image.descriptor(), &in_offset, out, &out_offset, length, 0) };
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            break;
+        }
+        if (counters != nullptr)
+        {
+            counters->add_write(static_cast<u64>(done));
+        }
+        length -= static_cast<u64>(done);
+    }
+
+    // file systems without copy_file_range support fall back to writing
+    // straight from the mapping
+    if (static_cast<u64>(in_offset) + length > image.size())
+    {
+        std::cerr << "Recovered data lies past the end of the image"
+                  << std::endl;
+        return false;
+    }
+    while (length > 0)
+    {
+        std::span<const u8> const source{ image.bytes(
+          static_cast<u64>(in_offset), length) };
+        ssize_t const done{ pwrite(
+          out, source.data(), source.size(), out_offset) };
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            std::cerr << "Could not write recovered data: "
+                      << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (counters != nullptr)
+        {
+            counters->add_write(static_cast<u64>(done));
+        }
+        in_offset += done;
+        out_offset += done;
+        length -= static_cast<u64>(done);
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+worker_pool::worker_pool(unsigned threads) noexcept
+{
+    threads = std::max(threads, 1U);
+    workers.reserve(threads);
+    for (unsigned i{ 0 }; i < threads; ++i)
+    {
+        workers.emplace_back([this] { work(); });
+    }
+}
+
+worker_pool::~worker_pool() noexcept
+{
+    {
+        std::scoped_lock guard{ lock };
+        stopping = true;
+    }
+    task_ready.notify_all();
+    // jthread joins on destruction
+}
+
+void worker_pool::submit(std::function<void()> task) noexcept
+{
+    {
+        std::scoped_lock guard{ lock };
+        tasks.emplace(std::move(task));
+    }
+    task_ready.notify_one();
+}
+
+void worker_pool::work() noexcept
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock guard{ lock };
+            task_ready.wait(guard,
+                            [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
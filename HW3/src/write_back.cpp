@@ -0,0 +1,158 @@
+#include "write_back.hpp"
+
+#include "mapped_image.hpp"
+#include "recovery_stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <span>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+write_back::write_back(const mapped_image& image,
+                       u64 block_size,
+                       io_counters* counters) noexcept
+  : image{ image }
+  , block_size{ block_size }
+  , counters{ counters }
+{
+}
+
+void write_back::stage(u32 b_num, std::span<const u8> data) noexcept
+{
+    std::scoped_lock guard{ lock };
+    std::vector<u8>& block{ dirty[b_num] };
+    block.assign(data.begin(), data.end());
+    block.resize(block_size, 0);
+}
+
+std::span<u8> write_back::edit(u32 b_num) noexcept
+{
+    std::scoped_lock guard{ lock };
+    auto [it, inserted]{ dirty.try_emplace(b_num) };
+    if (inserted)
+    {
+        std::span<const u8> const original{ image.block(b_num) };
+        it->second.assign(original.begin(), original.end());
+    }
+    return it->second;
+}
+
+std::span<const u8> write_back::view(u32 b_num) const noexcept
+{
+    std::scoped_lock guard{ lock };
+    auto const it{ dirty.find(b_num) };
+    if (it != dirty.end())
+    {
+        return it->second;
+    }
+    return image.block(b_num);
+}
+
+bool write_back::flush() noexcept
+{
+    std::scoped_lock guard{ lock };
+    std::erase_if(dirty,
+                  [this](const auto& entry)
+                  { return unchanged(entry.first, entry.second); });
+    bool ok{ true };
+    auto it{ dirty.begin() };
+    while (it != dirty.end())
+    {
+        // gather a run of consecutive blocks into one vectored write
+        u32 const first{ it->first };
+        std::vector<iovec> run;
+        for (u32 next{ first };
+             it != dirty.end() && it->first == next && run.size() < IOV_MAX;
+             ++it, ++next)
+        {
+            run.push_back({ it->second.data(), it->second.size() });
+        }
+
+        u64 offset{ static_cast<u64>(first) * block_size };
+        u64 remaining{ run.size() * block_size };
+        iovec* pending{ run.data() };
+        int count{ static_cast<int>(run.size()) };
+        while (remaining > 0)
+        {
+            ssize_t const done{ pwritev(
+              image.descriptor(), pending, count, static_cast<off_t>(offset)) };
+            if (counters != nullptr)
+            {
+                counters->add_write(done > 0 ? static_cast<u64>(done) : 0);
+            }
+            if (done < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                std::cerr << "pwritev failed at block " << first << ": "
+                          << std::strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+            // short write, skip what made it and retry the rest
+            u64 skip{ static_cast<u64>(done) };
+            offset += skip;
+            remaining -= skip;
+            while (count > 0 && skip >= pending->iov_len)
+            {
+                skip -= pending->iov_len;
+                ++pending;
+                --count;
+            }
+            if (count > 0)
+            {
+                pending->iov_base = static_cast<u8*>(pending->iov_base) + skip;
+                pending->iov_len -= skip;
+            }
+        }
+    }
+    if (ok)
+    {
+        dirty.clear();
+    }
+    return ok;
+}
+
+bool write_back::sync() const noexcept
+{
+    if (counters != nullptr)
+    {
+        counters->add_write(0);
+    }
+    if (fdatasync(image.descriptor()) < 0)
+    {
+        std::cerr << "fdatasync failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+u64 write_back::dirty_blocks() const noexcept
+{
+    std::scoped_lock guard{ lock };
+    return static_cast<u64>(
+      std::count_if(dirty.begin(),
+                    dirty.end(),
+                    [this](const auto& entry)
+                    { return !unchanged(entry.first, entry.second); }));
+}
+
+bool write_back::unchanged(u32 b_num,
+                           const std::vector<u8>& data) const noexcept
+{
+    std::span<const u8> const original{ image.block(b_num) };
+    return std::equal(data.begin(), data.end(), original.begin());
+}
@@ -0,0 +1,56 @@
+#!/bin/bash
+# A batch whose middle image has a zeroed super block: the other two must
+# still be recovered, and every report line must name its image.
+# usage: batch_corrupt_image.sh <recext2fs> <testcases1 dir> <scratch dir>
+set -u
+recext2fs=$1
+cases=$2
+work=$3/batch_corrupt_image
+identifier="01 $(printf '00 %.0s' {1..31})"
+
+rm -rf "$work"
+mkdir -p "$work"
+cp "$cases/example-1024-bitmap.img" "$work/first.img"
+cp "$cases/example-1024-bitmap.img" "$work/corrupt.img"
+cp "$cases/example-1024-blockbitmap.img" "$work/last.img"
+dd if=/dev/zero of="$work/corrupt.img" bs=1024 seek=1 count=1 \
+    conv=notrunc status=none
+for image in first corrupt last; do
+    echo "$work/$image.img $identifier"
+done > "$work/manifest"
+
+fail()
+{
+    echo "FAIL: $*"
+    exit 1
+}
+
+check_report()
+{
+    local report=$1
+    grep -qx "$work/first.img: ok" "$report" || fail "first image not ok"
+    grep -qx "$work/corrupt.img: failed" "$report" ||
+        fail "corrupt image not reported as failed"
+    grep -qx "$work/last.img: ok" "$report" || fail "last image not ok"
+    grep -v "^$work/\(first\|corrupt\|last\)\.img: " "$report" &&
+        fail "report lines without an image prefix"
+    return 0
+}
+
+"$recext2fs" --threads=4 --batch="$work/manifest" > "$work/recover.out"
+[ $? = 1 ] || fail "batch with a corrupt image did not exit with 1"
+check_report "$work/recover.out"
+for image in first last; do
+    cmp -s "$work/$image.img" "$cases/example-1024-baseline.img" ||
+        fail "$image.img differs from the baseline"
+done
+
+"$recext2fs" --threads=4 --verify --batch="$work/manifest" \
+    > "$work/verify.out"
+[ $? = 1 ] || fail "verify batch did not exit with 1"
+check_report "$work/verify.out"
+for image in first last; do
+    grep -qx "$work/$image.img: verify: bitmaps match" "$work/verify.out" ||
+        fail "no verify line for $image.img"
+done
+echo "batch_corrupt_image: ok"
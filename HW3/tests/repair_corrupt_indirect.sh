@@ -0,0 +1,50 @@
+#!/bin/bash
+# A lost double indirect pointer replaced by garbage: one past the end of the
+# file system, one into the inode table. Pointer repair must treat both as
+# lost and come up with the same image as for the plain missing pointer.
+# usage: repair_corrupt_indirect.sh <recext2fs> <testcases1 dir> <scratch dir>
+set -u
+recext2fs=$1
+cases=$2
+work=$3/repair_corrupt_indirect
+identifier="01 $(printf '00 %.0s' {1..31})"
+
+# inode 20 of the bundled images: table at block 5, 256 byte inodes,
+# i_block at 40 and the double indirect pointer is entry 13 of it
+dind_offset=$((5 * 1024 + 19 * 256 + 40 + 13 * 4))
+
+fail()
+{
+    echo "FAIL: $*"
+    exit 1
+}
+
+# writes a little endian 32 bit value at a byte offset
+poke_u32()
+{
+    local value=$2
+    printf "\\$(printf %03o $((value & 0xff)))\\$(printf %03o \
+$(((value >> 8) & 0xff)))\\$(printf %03o $(((value >> 16) & 0xff)))\\$(\
+printf %03o $(((value >> 24) & 0xff)))" |
+        dd of="$1" bs=1 seek="$3" conv=notrunc status=none
+}
+
+rm -rf "$work"
+mkdir -p "$work"
+cp "$cases/example-1024-bitmap-pointer.img" "$work/expected.img"
+"$recext2fs" "$work/expected.img" $identifier --repair-pointers \
+    > "$work/expected.out" || fail "repair of the untouched image failed"
+
+for pointer in 4000000 5; do
+    image=$work/corrupt-$pointer.img
+    cp "$cases/example-1024-bitmap-pointer.img" "$image"
+    poke_u32 "$image" "$pointer" "$dind_offset"
+    "$recext2fs" "$image" $identifier --repair-pointers \
+        > "$work/corrupt-$pointer.out"
+    status=$?
+    [ $status = 0 ] ||
+        fail "double indirect pointer $pointer: exit status $status"
+    cmp -s "$image" "$work/expected.img" ||
+        fail "double indirect pointer $pointer was not replaced"
+done
+echo "repair_corrupt_indirect: ok"
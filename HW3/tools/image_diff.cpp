@@ -0,0 +1,256 @@
+#include "bit_diff.hpp"
+#include "ext2fs.hpp"
+#include "geometry.hpp"
+#include "mapped_image.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+using u8 = std::uint8_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+
+// Scores a recovered image against the original and the damaged image it was
+// recovered from. Every unit (bitmap bit, group descriptor, inode) that
+// differs between truth and start is damage; it is fixed when it matches the
+// truth again afterwards. Units that start out right and end up different
+// are new differences. Only metadata is compared and identical stretches are
+// skipped with vector XOR, so the cost does not grow with the data.
+namespace
+{
+// How many ranges of each kind to print before summarising the rest
+constexpr u64 listed_ranges{ 16 };
+
+struct tally
+{
+    const char* name;
+    const char* unit;
+    u64 damaged{ 0 };
+    u64 fixed{ 0 };
+    u64 introduced{ 0 };
+    std::vector<bit_range> unfixed{};
+    std::vector<bit_range> created{};
+};
+
+void compare_bitmaps(tally& result,
+                     std::span<const u8> truth,
+                     std::span<const u8> start,
+                     std::span<const u8> fixed,
+                     u64 bit_count,
+                     u64 first_unit)
+{
+    u64 const bytes{ (bit_count + 7) / 8 };
+    truth = truth.first(bytes);
+    start = start.first(bytes);
+    fixed = fixed.first(bytes);
+    for (u64 base{ 0 }; base < bit_count; base += 64)
+    {
+        u64 const next{ std::min(first_difference(truth, start, base / 8),
+                                 first_difference(truth, fixed, base / 8)) };
+        base = next / 8 * 64;
+        if (base >= bit_count)
+        {
+            break;
+        }
+        u64 const t{ load_word(truth, base / 8) };
+        u64 damage{ t ^ load_word(start, base / 8) };
+        u64 wrong{ t ^ load_word(fixed, base / 8) };
+        if (bit_count - base < 64)
+        {
+            u64 const mask{ (u64{ 1 } << (bit_count - base)) - 1 };
+            damage &= mask;
+            wrong &= mask;
+        }
+        result.damaged += std::popcount(damage);
+        result.fixed += std::popcount(damage & ~wrong);
+        result.introduced += std::popcount(~damage & wrong);
+        append_bits(result.unfixed, damage & wrong, first_unit + base);
+        append_bits(result.created, ~damage & wrong, first_unit + base);
+    }
+}
+
+void compare_records(tally& result,
+                     std::span<const u8> truth,
+                     std::span<const u8> start,
+                     std::span<const u8> fixed,
+                     u64 record_size,
+                     u64 first_unit)
+{
+    for (u64 pos{ 0 }; pos < truth.size();)
+    {
+        u64 const next{ std::min(first_difference(truth, start, pos),
+                                 first_difference(truth, fixed, pos)) };
+        if (next >= truth.size())
+        {
+            break;
+        }
+        u64 const record{ next / record_size };
+        u64 const offset{ record * record_size };
+        bool const damage{ std::memcmp(truth.data() + offset,
+                                       start.data() + offset,
+                                       record_size) != 0 };
+        bool const wrong{ std::memcmp(truth.data() + offset,
+                                      fixed.data() + offset,
+                                      record_size) != 0 };
+        result.damaged += damage;
+        result.fixed += damage && !wrong;
+        result.introduced += !damage && wrong;
+        if (wrong)
+        {
+            append_range(damage ? result.unfixed : result.created,
+                         first_unit + record,
+                         first_unit + record + 1);
+        }
+        pos = offset + record_size;
+    }
+}
+
+double percent(u64 part, u64 whole)
+{
+    return whole == 0 ? 100.0 : 100.0 * static_cast<double>(part) /
+                                  static_cast<double>(whole);
+}
+
+void print_ranges(const tally& result,
+                  const char* what,
+                  const std::vector<bit_range>& ranges)
+{
+    if (ranges.empty())
+    {
+        return;
+    }
+    std::cout << result.name << " " << what << ":";
+    for (u64 i{ 0 }; i < std::min<u64>(ranges.size(), listed_ranges); ++i)
+    {
+        std::cout << " " << ranges[i].first;
+        if (ranges[i].end - ranges[i].first > 1)
+        {
+            std::cout << "-" << ranges[i].end - 1;
+        }
+    }
+    if (ranges.size() > listed_ranges)
+    {
+        std::cout << " and " << ranges.size() - listed_ranges
+                  << " more ranges";
+    }
+    std::cout << " (" << result.unit << "s)" << std::endl;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 4)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <truth_image> <starting_image> <fixed_image>"
+                  << std::endl;
+        return 2;
+    }
+
+    try
+    {
+        mapped_image const truth{ argv[1], image_access::read_only };
+        mapped_image const start{ argv[2], image_access::read_only };
+        mapped_image const fixed{ argv[3], image_access::read_only };
+        if (start.size() != truth.size() || fixed.size() != truth.size())
+        {
+            std::cerr << "Images differ in size" << std::endl;
+            return 2;
+        }
+
+        // the truth's layout is used for all three, damage may have hit
+        // the descriptors of the others
+        geometry const geo{ truth };
+        u32 const groups{ geo.group_count() };
+        tally block_bitmap{ .name = "block bitmap", .unit = "block" };
+        tally inode_bitmap{ .name = "inode bitmap", .unit = "inode" };
+        tally descriptors{ .name = "descriptor table", .unit = "group" };
+        tally inode_table{ .name = "inode table", .unit = "inode" };
+
+        u64 const table_bytes{ static_cast<u64>(groups) *
+                               sizeof(ext2_block_group_descriptor) };
+        u64 const table_offset{ geo.descriptor_offset(0) };
+        compare_records(descriptors,
+                        truth.bytes(table_offset, table_bytes),
+                        start.bytes(table_offset, table_bytes),
+                        fixed.bytes(table_offset, table_bytes),
+                        sizeof(ext2_block_group_descriptor),
+                        0);
+
+        u64 const inodes_bytes{ static_cast<u64>(geo.inodes_per_group()) *
+                                geo.inode_size() };
+        for (u32 bg_num{ 0 }; bg_num < groups; ++bg_num)
+        {
+            group_layout const& layout{ geo.group(bg_num) };
+            u64 const first_inode{ static_cast<u64>(bg_num) *
+                                     geo.inodes_per_group() +
+                                   1 };
+            compare_bitmaps(block_bitmap,
+                            truth.block(layout.block_bitmap),
+                            start.block(layout.block_bitmap),
+                            fixed.block(layout.block_bitmap),
+                            layout.block_count,
+                            layout.first_block);
+            compare_bitmaps(inode_bitmap,
+                            truth.block(layout.inode_bitmap),
+                            start.block(layout.inode_bitmap),
+                            fixed.block(layout.inode_bitmap),
+                            geo.inodes_per_group(),
+                            first_inode);
+            u64 const table{ geo.block_offset(layout.inode_table) };
+            compare_records(inode_table,
+                            truth.bytes(table, inodes_bytes),
+                            start.bytes(table, inodes_bytes),
+                            fixed.bytes(table, inodes_bytes),
+                            geo.inode_size(),
+                            first_inode);
+        }
+
+        std::vector<const tally*> const results{
+            &block_bitmap, &inode_bitmap, &descriptors, &inode_table
+        };
+        u64 damaged{ 0 };
+        u64 repaired{ 0 };
+        u64 introduced{ 0 };
+        std::cout << std::left << std::setw(18) << "" << std::right
+                  << std::setw(10) << "damaged" << std::setw(10) << "fixed"
+                  << std::setw(10) << "new" << std::setw(10) << "score"
+                  << std::endl;
+        for (const tally* result : results)
+        {
+            std::cout << std::left << std::setw(18) << result->name
+                      << std::right << std::setw(10) << result->damaged
+                      << std::setw(10) << result->fixed << std::setw(10)
+                      << result->introduced << std::setw(9) << std::fixed
+                      << std::setprecision(1)
+                      << percent(result->fixed, result->damaged) << "%"
+                      << std::endl;
+            damaged += result->damaged;
+            repaired += result->fixed;
+            introduced += result->introduced;
+        }
+        for (const tally* result : results)
+        {
+            print_ranges(*result, "not fixed", result->unfixed);
+            print_ranges(*result, "newly different", result->created);
+        }
+        std::cout << "score " << std::fixed << std::setprecision(1)
+                  << percent(repaired, damaged) << "% of " << damaged
+                  << " differences fixed, " << introduced << " introduced"
+                  << std::endl;
+        return repaired == damaged && introduced == 0 ? 0 : 1;
+    }
+    catch (const std::exception&)
+    {
+        // the image or its geometry has already said what went wrong
+        return 2;
+    }
+}